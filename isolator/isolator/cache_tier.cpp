@@ -0,0 +1,297 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "linux/fs.hpp"
+
+#include "cache_tier.hpp"
+#include "mount_utils.hpp"
+
+using std::string;
+using std::vector;
+
+namespace fs = mesos::internal::fs;
+
+namespace mesos {
+namespace slave {
+
+static constexpr char DM_DEVICE_PREFIX[]          = "/dev/mapper/";
+static constexpr char CACHE_DEVICE_PREFIX[]       = "dvdi-cache-";
+
+// dm-cache block size in 512 byte sectors.
+static constexpr size_t CACHE_BLOCK_SECTORS       = 512;
+
+// The metadata volume gets a thousandth of the cache, and no less than
+// the smallest metadata device dm-cache accepts.
+static constexpr uint64_t CACHE_METADATA_RATIO    = 1000;
+static const Bytes CACHE_METADATA_MINIMUM         = Megabytes(8);
+
+// Index of the dirty block count in the status of a cache target,
+// after the start, length and target type fields.
+static constexpr size_t CACHE_STATUS_DIRTY_INDEX  = 13;
+
+static Try<string> run(const string& command)
+{
+  LOG(INFO) << "Invoking " << command;
+
+  Try<string> output = os::shell("%s 2>&1", command.c_str());
+  if (output.isError()) {
+    return Error("'" + command + "' failed: " + output.error());
+  }
+
+  return output.get();
+}
+
+// Logical volume and device mapper names may only use a few characters.
+static string deviceName(const ExternalMount& em)
+{
+  string name = em.volumedriver() + "-" + em.volumename();
+  std::replace_if(name.begin(), name.end(), [](char c) {
+    return !isalnum(c) && c != '.' && c != '_' && c != '-' && c != '+';
+  }, '_');
+
+  return name;
+}
+
+CacheTier::CacheTier(const string& _volumeGroup, const Duration& _flushTimeout)
+  : volumeGroup(_volumeGroup),
+    flushTimeout(_flushTimeout) {}
+
+Try<VolumeCache> CacheTier::attach(
+    const ExternalMount& em,
+    const string& mountpoint,
+    const string& mode,
+    const Bytes& size) const
+{
+  if (!enabled()) {
+    return Error("No cache volume group is configured");
+  }
+
+  Result<fs::MountInfoTable::Entry> mount = findMount(mountpoint);
+  if (mount.isError()) {
+    return Error(mount.error());
+  } else if (mount.isNone()) {
+    return Error(mountpoint + " is not mounted");
+  }
+
+  const string origin = mount.get().source;
+  const string fstype = mount.get().type;
+  if (!strings::startsWith(origin, "/dev/")) {
+    return Error("Volume " + em.volumename() + " is not on a block device");
+  }
+
+  Try<string> sectors = run("blockdev --getsz " + origin);
+  if (sectors.isError()) {
+    return Error(sectors.error());
+  }
+
+  const string name = deviceName(em);
+
+  VolumeCache cache;
+  cache.set_device(CACHE_DEVICE_PREFIX + name);
+  cache.set_origin(origin);
+  cache.set_mode(mode);
+  cache.set_datalv(volumeGroup + "/" + name + "-cdata");
+  cache.set_metadatalv(volumeGroup + "/" + name + "-cmeta");
+  cache.set_fstype(fstype);
+
+  const Bytes metadataSize = std::max(
+      CACHE_METADATA_MINIMUM, Bytes(size.bytes() / CACHE_METADATA_RATIO));
+
+  // lvcreate zeroes the start of each volume, dm-cache takes zeroed
+  // metadata to mean an empty cache.
+  Try<string> created = run(
+      "lvcreate -y -Z y -L " + stringify(size.bytes()) + "b -n " + name +
+      "-cdata " + volumeGroup);
+  if (created.isSome()) {
+    created = run(
+        "lvcreate -y -Z y -L " + stringify(metadataSize.bytes()) + "b -n " +
+        name + "-cmeta " + volumeGroup);
+    if (created.isError()) {
+      run("lvremove -y " + cache.datalv());
+    }
+  }
+
+  if (created.isError()) {
+    return Error(created.error());
+  }
+
+  const string table =
+    "0 " + strings::trim(sectors.get()) + " cache /dev/" +
+    cache.metadatalv() + " /dev/" + cache.datalv() + " " + origin + " " +
+    stringify(CACHE_BLOCK_SECTORS) + " 1 " + mode + " default 0";
+
+  Try<Nothing> unmounted = fs::unmount(mountpoint);
+  if (unmounted.isError()) {
+    run("lvremove -y " + cache.datalv() + " " + cache.metadatalv());
+    return Error("Failed to unmount " + mountpoint + ": " + unmounted.error());
+  }
+
+  Try<string> dmsetup =
+    run("dmsetup create " + cache.device() + " --table '" + table + "'");
+
+  Try<Nothing> mounted = Error("cache device was not created");
+  if (dmsetup.isSome()) {
+    mounted = fs::mount(
+        DM_DEVICE_PREFIX + cache.device(), mountpoint, fstype, 0, NULL);
+    if (mounted.isError()) {
+      run("dmsetup remove " + cache.device());
+    }
+  }
+
+  if (mounted.isError()) {
+    run("lvremove -y " + cache.datalv() + " " + cache.metadatalv());
+
+    Try<Nothing> restored = fs::mount(origin, mountpoint, fstype, 0, NULL);
+    if (restored.isError()) {
+      LOG(ERROR) << "Failed to mount " << origin << " at " << mountpoint
+                 << " again: " << restored.error();
+    }
+
+    return Error("Failed to mount the cached device: " +
+                 (dmsetup.isError() ? dmsetup.error() : mounted.error()));
+  }
+
+  LOG(INFO) << "Volume " << em.volumename() << " at " << mountpoint
+            << " is cached in " << mode << " mode on " << cache.device();
+
+  return cache;
+}
+
+Try<Nothing> CacheTier::detach(
+    const VolumeCache& cache,
+    const string& mountpoint) const
+{
+  Result<fs::MountInfoTable::Entry> mount = findMount(mountpoint);
+  if (mount.isError()) {
+    return Error(mount.error());
+  }
+
+  if (mount.isSome() && mount.get().source != cache.origin()) {
+    Try<Nothing> unmounted = fs::unmount(mountpoint);
+    if (unmounted.isError()) {
+      return Error("Failed to unmount " + mountpoint + ": " +
+                   unmounted.error());
+    }
+  }
+
+  // The device is gone if an earlier detach got past its removal.
+  if (run("dmsetup info " + cache.device()).isSome()) {
+    if (cache.mode() == CACHE_WRITEBACK) {
+      // The cleaner policy writes every dirty block back to the origin.
+      Try<string> table = run("dmsetup table " + cache.device());
+      if (table.isError()) {
+        return Error(table.error());
+      }
+
+      vector<string> tokens = strings::tokenize(table.get(), " \n");
+      if (tokens.size() < 7) {
+        return Error("Unexpected table for " + cache.device() + ": " +
+                     table.get());
+      }
+      tokens.resize(7);
+
+      Try<string> cleaner = run("dmsetup suspend " + cache.device());
+      if (cleaner.isSome()) {
+        cleaner = run(
+            "dmsetup reload " + cache.device() + " --table '" +
+            strings::join(" ", tokens) + " 0 cleaner 0'");
+      }
+      Try<string> resumed = run("dmsetup resume " + cache.device());
+      if (cleaner.isError() || resumed.isError()) {
+        return Error("Failed to switch " + cache.device() +
+                     " to the cleaner policy: " +
+                     (cleaner.isError() ? cleaner.error() : resumed.error()));
+      }
+
+      Stopwatch stopwatch;
+      stopwatch.start();
+
+      while (true) {
+        Try<string> status = run("dmsetup status " + cache.device());
+        if (status.isError()) {
+          return Error(status.error());
+        }
+
+        tokens = strings::tokenize(status.get(), " \n");
+        Try<uint64_t> dirty = tokens.size() > CACHE_STATUS_DIRTY_INDEX
+          ? numify<uint64_t>(tokens[CACHE_STATUS_DIRTY_INDEX])
+          : Try<uint64_t>(Error("Unexpected status: " + status.get()));
+        if (dirty.isError()) {
+          return Error("Failed to read the dirty blocks of " +
+                       cache.device() + ": " + dirty.error());
+        }
+
+        if (dirty.get() == 0) {
+          break;
+        }
+
+        if (stopwatch.elapsed() > flushTimeout) {
+          return Error(cache.device() + " still has " +
+                       stringify(dirty.get()) + " dirty blocks after " +
+                       stringify(flushTimeout));
+        }
+
+        os::sleep(Seconds(1));
+      }
+
+      LOG(INFO) << "Flushed " << cache.device() << " in "
+                << stopwatch.elapsed();
+    }
+
+    Try<string> removed = run("dmsetup remove " + cache.device());
+    if (removed.isError()) {
+      return Error(removed.error());
+    }
+  }
+
+  // Removing logical volumes that are already gone fails, which is fine.
+  run("lvremove -y " + cache.datalv() + " " + cache.metadatalv());
+
+  if (mount.isNone() || mount.get().source != cache.origin()) {
+    Try<Nothing> mounted = fs::mount(
+        cache.origin(), mountpoint, cache.fstype(), 0, NULL);
+    if (mounted.isError()) {
+      LOG(WARNING) << "Failed to mount " << cache.origin() << " at "
+                   << mountpoint << " again, the volume driver will find "
+                   << "it unmounted: " << mounted.error();
+    }
+  }
+
+  LOG(INFO) << "Removed cache " << cache.device() << " of " << mountpoint;
+
+  return Nothing();
+}
+
+} /* namespace slave */
+} /* namespace mesos */
@@ -0,0 +1,77 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_CACHE_TIER_HPP_
+#define SRC_CACHE_TIER_HPP_
+
+#include <string>
+
+#include <stout/bytes.hpp>
+#include <stout/duration.hpp>
+#include <stout/nothing.hpp>
+#include <stout/try.hpp>
+
+#include "interface.hpp"
+
+namespace mesos {
+namespace slave {
+
+static constexpr char CACHE_WRITETHROUGH[]        = "writethrough";
+static constexpr char CACHE_WRITEBACK[]           = "writeback";
+
+// Stacks a dm-cache device over the device of a mounted volume, with
+// the cache and its metadata on logical volumes carved out of a volume
+// group on local SSD, and mounts the cached device in its place.
+//
+// In writeback mode the cache holds writes the origin does not have
+// yet, so detach() flushes them with the cleaner policy before the
+// cache is removed, and fails rather than lose them.
+class CacheTier
+{
+public:
+  // An empty volumeGroup disables attach(), detach() still works for
+  // caches made before the volume group was unconfigured.
+  CacheTier(const std::string& volumeGroup, const Duration& flushTimeout);
+
+  bool enabled() const { return !volumeGroup.empty(); }
+
+  // Replaces the mount at mountpoint with a cached one. On failure the
+  // original mount is restored.
+  Try<VolumeCache> attach(
+      const ExternalMount& em,
+      const std::string& mountpoint,
+      const std::string& mode,
+      const Bytes& size) const;
+
+  // Unmounts the cached device, flushes and removes the cache, and
+  // mounts the origin device at mountpoint again, as the volume driver
+  // left it.
+  Try<Nothing> detach(
+      const VolumeCache& cache,
+      const std::string& mountpoint) const;
+
+private:
+  const std::string volumeGroup;
+  const Duration flushTimeout;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_CACHE_TIER_HPP_ */
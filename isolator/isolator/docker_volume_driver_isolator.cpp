@@ -17,6 +17,9 @@
  * limitations under the License.
  */
 
+#include <sched.h>
+
+#include <algorithm>
 #include <fstream>
 #include <list>
 #include <array>
@@ -32,6 +35,7 @@
 #include <glog/logging.h>
 #include <mesos/type_utils.hpp>
 
+#include <process/collect.hpp>
 #include <process/process.hpp>
 #include <process/subprocess.hpp>
 
@@ -42,6 +46,10 @@ using namespace mesos::internal;
 #include <stout/nothing.hpp>
 #include <stout/os.hpp>
 #include <stout/format.hpp>
+#include <stout/net.hpp>
+#include <stout/hashset.hpp>
+#include <stout/numify.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/strings.hpp>
 
 using namespace process;
@@ -75,15 +83,98 @@ const char DockerVolumeDriverIsolator::prohibitedchars[NUM_PROHIBITED]  =
 
 std::string DockerVolumeDriverIsolator::mountPbFilename;
 std::string DockerVolumeDriverIsolator::mesosWorkingDir;
+Duration DockerVolumeDriverIsolator::reconcileInterval;
+bool DockerVolumeDriverIsolator::reconcileRepair = false;
+size_t DockerVolumeDriverIsolator::reconcileBatchSize =
+  RECONCILE_BATCH_DEFAULT;
+DriverLimits DockerVolumeDriverIsolator::defaultDriverLimits;
+hashmap<std::string, DriverLimits> DockerVolumeDriverIsolator::driverLimits;
+Duration DockerVolumeDriverIsolator::driverPriorityAging;
+std::string DockerVolumeDriverIsolator::cacheVolumeGroup;
+Bytes DockerVolumeDriverIsolator::cacheSize;
+Duration DockerVolumeDriverIsolator::cacheFlushTimeout;
+std::vector<PoolClass> DockerVolumeDriverIsolator::poolClasses;
+Duration DockerVolumeDriverIsolator::poolInterval;
+std::string DockerVolumeDriverIsolator::poolAliasDir;
+std::string DockerVolumeDriverIsolator::poolPbFilename;
+Duration DockerVolumeDriverIsolator::flushInterval;
+Bytes DockerVolumeDriverIsolator::flushThreshold;
+std::string DockerVolumeDriverIsolator::leaseDir;
+Duration DockerVolumeDriverIsolator::leaseTtl;
+std::string DockerVolumeDriverIsolator::leaseHolder;
+std::string DockerVolumeDriverIsolator::forceDetachCommand;
+std::string DockerVolumeDriverIsolator::lvmThinPool;
+std::string DockerVolumeDriverIsolator::lvmSnapshotPrefix;
+std::vector<std::string> DockerVolumeDriverIsolator::nativeBindAllowed;
 
 
 DockerVolumeDriverIsolator::DockerVolumeDriverIsolator(
-  const Parameters& _parameters)
-  : parameters(_parameters)
+  const Parameters& _parameters,
+  const process::Owned<VolumeDriver>& _driverOverride)
+  : parameters(_parameters),
+    pluginRegistry(new VolumePluginRegistry()),
+    scheduler(new DriverOperationScheduler(
+        defaultDriverLimits, driverLimits, driverPriorityAging)),
+    dvdcliDriver(
+        new DvdcliVolumeDriver(forceDetachCommand)),
+    nativeDriver(new NativeVolumeDriver(nativeBindAllowed)),
+    thinDriver(new ThinVolumeDriver(lvmThinPool, lvmSnapshotPrefix)),
+    driverOverride(_driverOverride),
+    cacheTier(new CacheTier(cacheVolumeGroup, cacheFlushTimeout)),
+    endpoints(new HttpEndpoints(DVDI_ENDPOINTS_ID)),
+    workers(new WorkQueue(UNMOUNT_WORKERS)),
+    syncers(new WorkQueue(SYNC_WORKERS))
   {
     // Verify that the version of the library that we linked against is
     // compatible with the version of the headers we compiled against.
     GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    if (reconcileInterval > Duration::zero()) {
+      reconciler = process::Owned<PeriodicTask>(new PeriodicTask(
+          "dvdi-reconciler", reconcileInterval, [this]() { reconcile(); }));
+      process::spawn(reconciler.get());
+    }
+
+    if (flushInterval > Duration::zero()) {
+      flusher = process::Owned<PeriodicTask>(new PeriodicTask(
+          "dvdi-flusher", flushInterval, [this]() { flushVolumes(); }));
+      process::spawn(flusher.get());
+    }
+
+    if (!leaseDir.empty()) {
+      leaseStore = process::Owned<LeaseStore>(new FileLeaseStore(leaseDir));
+      leaseRenewer = process::Owned<PeriodicTask>(new PeriodicTask(
+          "dvdi-lease-renewer", leaseTtl / 3, [this]() { renewLeases(); }));
+      process::spawn(leaseRenewer.get());
+    }
+
+    if (!poolClasses.empty()) {
+      volumePool = process::Owned<VolumePool>(
+          new VolumePool(poolClasses, poolPbFilename, poolAliasDir));
+      poolRefiller = process::Owned<PeriodicTask>(new PeriodicTask(
+          "dvdi-pool-refiller", poolInterval, [this]() { refillPool(); }));
+      process::spawn(poolRefiller.get());
+    }
+
+    DriverOperationScheduler* driverScheduler = scheduler.get();
+    endpoints->add(
+        DRIVERS_ENDPOINT_NAME,
+        "Queue depth and wait times of volume driver operations.",
+        [driverScheduler]() { return driverScheduler->stats(); });
+
+    endpoints->add(
+        CONTAINERS_ENDPOINT_NAME,
+        "Where the storage time of each container's launch went.",
+        [this]() { return containerTimings(); });
+
+    if (volumePool.get() != NULL) {
+      VolumePool* pool = volumePool.get();
+      endpoints->add(
+          POOL_ENDPOINT_NAME,
+          "Blank volumes available in the volume pool.",
+          [pool]() { return pool->stats(); });
+    }
+    process::spawn(endpoints.get());
   }
 
 Try<Isolator*> DockerVolumeDriverIsolator::create(
@@ -99,11 +190,39 @@ Try<Isolator*> DockerVolumeDriverIsolator::create(
     return Error("DockerVolumeDriverIsolator requires root privileges");
   }
 
+  return create(parameters, process::Owned<VolumeDriver>());
+}
+
+Try<Isolator*> DockerVolumeDriverIsolator::create(
+    const Parameters& parameters,
+    const process::Owned<VolumeDriver>& driver)
+{
   LOG(INFO) << "DockerVolumeDriverIsolator::create() called";
   mountPbFilename = DVDI_MOUNTLIST_DEFAULT_DIR;
   //TODO: we dont have the flags.work_dir yet. Hardcoded for /tmp/mesos
   //this will be overwritten with environment parameters below
   mesosWorkingDir = DEFAULT_WORKING_DIR;
+  reconcileInterval = Duration::parse(RECONCILE_INTERVAL_DEFAULT).get();
+  reconcileRepair = false;
+  reconcileBatchSize = RECONCILE_BATCH_DEFAULT;
+  defaultDriverLimits = DriverLimits();
+  driverPriorityAging = Duration::parse(DRIVER_PRIORITY_AGING_DEFAULT).get();
+  cacheVolumeGroup = "";
+  cacheSize = Bytes::parse(CACHE_SIZE_DEFAULT).get();
+  cacheFlushTimeout = Duration::parse(CACHE_FLUSH_TIMEOUT_DEFAULT).get();
+  poolClasses.clear();
+  poolInterval = Duration::parse(VOLUME_POOL_INTERVAL_DEFAULT).get();
+  poolAliasDir = "";
+  flushInterval = Duration::parse(FLUSH_INTERVAL_DEFAULT).get();
+  flushThreshold = Bytes::parse(FLUSH_THRESHOLD_DEFAULT).get();
+  leaseDir = "";
+  leaseTtl = Duration::parse(LEASE_TTL_DEFAULT).get();
+  leaseHolder = "";
+  forceDetachCommand = "";
+  lvmThinPool = "";
+  lvmSnapshotPrefix = LVM_SNAPSHOT_PREFIX_DEFAULT;
+  nativeBindAllowed.clear();
+  std::string driverLimitsParameter;
 
   foreach (const Parameter& parameter, parameters.parameter()) {
     if (parameter.key() == DVDI_WORKDIR_PARAM_NAME) {
@@ -120,18 +239,305 @@ Try<Isolator*> DockerVolumeDriverIsolator::create(
            << " parameter is invalid, must start and end with /";
         return Error(ss.str());
       }
+    } else if (parameter.key() == RECONCILE_INTERVAL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> interval = Duration::parse(parameter.value());
+      if (interval.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(RECONCILE_INTERVAL_PARAM_NAME) +
+                     " parameter is invalid: " + interval.error());
+      }
+      reconcileInterval = interval.get();
+    } else if (parameter.key() == RECONCILE_REPAIR_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      reconcileRepair = (parameter.value() == "true");
+    } else if (parameter.key() == RECONCILE_BATCH_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<size_t> batchSize = numify<size_t>(parameter.value());
+      if (batchSize.isError() || batchSize.get() == 0) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(RECONCILE_BATCH_PARAM_NAME) +
+                     " parameter is invalid, must be a positive integer");
+      }
+      reconcileBatchSize = batchSize.get();
+    } else if (parameter.key() == DRIVER_RATE_PARAM_NAME ||
+               parameter.key() == DRIVER_BURST_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<double> number = numify<double>(parameter.value());
+      if (number.isError() || number.get() < 0 ||
+          (parameter.key() == DRIVER_BURST_PARAM_NAME && number.get() < 1)) {
+        return Error("DockerVolumeDriverIsolator " + parameter.key() +
+                     " parameter is invalid");
+      }
+
+      if (parameter.key() == DRIVER_RATE_PARAM_NAME) {
+        defaultDriverLimits.rate = number.get();
+      } else {
+        defaultDriverLimits.burst = number.get();
+      }
+    } else if (parameter.key() == DRIVER_CONCURRENCY_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<size_t> concurrency = numify<size_t>(parameter.value());
+      if (concurrency.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(DRIVER_CONCURRENCY_PARAM_NAME) +
+                     " parameter is invalid, must be a non-negative integer");
+      }
+      defaultDriverLimits.concurrency = concurrency.get();
+    } else if (parameter.key() == DRIVER_LIMITS_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      // Parsed below, once the defaults are known.
+      driverLimitsParameter = parameter.value();
+    } else if (parameter.key() == DRIVER_PRIORITY_AGING_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> aging = Duration::parse(parameter.value());
+      if (aging.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(DRIVER_PRIORITY_AGING_PARAM_NAME) +
+                     " parameter is invalid: " + aging.error());
+      }
+      driverPriorityAging = aging.get();
+    } else if (parameter.key() == CACHE_VG_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      if (parameter.value().find_first_of(
+              prohibitedchars, 0, NUM_PROHIBITED) != string::npos) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(CACHE_VG_PARAM_NAME) +
+                     " parameter is invalid");
+      }
+      cacheVolumeGroup = parameter.value();
+    } else if (parameter.key() == CACHE_SIZE_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Bytes> size = Bytes::parse(parameter.value());
+      if (size.isError() || size.get() == Bytes(0)) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(CACHE_SIZE_PARAM_NAME) +
+                     " parameter is invalid, must be a size such as 10GB");
+      }
+      cacheSize = size.get();
+    } else if (parameter.key() == CACHE_FLUSH_TIMEOUT_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> timeout = Duration::parse(parameter.value());
+      if (timeout.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(CACHE_FLUSH_TIMEOUT_PARAM_NAME) +
+                     " parameter is invalid: " + timeout.error());
+      }
+      cacheFlushTimeout = timeout.get();
+    } else if (parameter.key() == VOLUME_POOL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<std::vector<PoolClass>> classes =
+        VolumePool::parse(parameter.value());
+      if (classes.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(VOLUME_POOL_PARAM_NAME) +
+                     " parameter is invalid: " + classes.error());
+      }
+
+      // The class options end up on the dvdcli command line.
+      foreach (const PoolClass& poolClass, classes.get()) {
+        const std::string fields =
+          poolClass.driver + poolClass.size + poolClass.fstype;
+        if (fields.find_first_of(prohibitedchars, 0, NUM_PROHIBITED) !=
+            string::npos) {
+          return Error("DockerVolumeDriverIsolator " +
+                       std::string(VOLUME_POOL_PARAM_NAME) +
+                       " parameter is invalid, class " + poolClass.key() +
+                       " contains prohibited characters");
+        }
+      }
+      poolClasses = classes.get();
+    } else if (parameter.key() == VOLUME_POOL_INTERVAL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> interval = Duration::parse(parameter.value());
+      if (interval.isError() || interval.get() <= Duration::zero()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(VOLUME_POOL_INTERVAL_PARAM_NAME) +
+                     " parameter is invalid, must be a positive duration");
+      }
+      poolInterval = interval.get();
+    } else if (parameter.key() == VOLUME_POOL_ALIAS_DIR_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      if (!strings::startsWith(parameter.value(), "/")) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(VOLUME_POOL_ALIAS_DIR_PARAM_NAME) +
+                     " parameter is invalid, must be an absolute path");
+      }
+      poolAliasDir = parameter.value();
+    } else if (parameter.key() == FLUSH_INTERVAL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> interval = Duration::parse(parameter.value());
+      if (interval.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(FLUSH_INTERVAL_PARAM_NAME) +
+                     " parameter is invalid: " + interval.error());
+      }
+      flushInterval = interval.get();
+    } else if (parameter.key() == FLUSH_THRESHOLD_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Bytes> threshold = Bytes::parse(parameter.value());
+      if (threshold.isError()) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(FLUSH_THRESHOLD_PARAM_NAME) +
+                     " parameter is invalid, must be a size such as 256MB");
+      }
+      flushThreshold = threshold.get();
+    } else if (parameter.key() == LEASE_DIR_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      if (!strings::startsWith(parameter.value(), "/")) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(LEASE_DIR_PARAM_NAME) +
+                     " parameter is invalid, must be an absolute path");
+      }
+      leaseDir = parameter.value();
+    } else if (parameter.key() == LEASE_TTL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      Try<Duration> ttl = Duration::parse(parameter.value());
+      if (ttl.isError() || ttl.get() < Seconds(3)) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(LEASE_TTL_PARAM_NAME) +
+                     " parameter is invalid, must be at least 3secs");
+      }
+      leaseTtl = ttl.get();
+    } else if (parameter.key() == LEASE_HOLDER_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      if (parameter.value().empty() ||
+          parameter.value().find_first_of(
+              prohibitedchars, 0, NUM_PROHIBITED) != string::npos) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(LEASE_HOLDER_PARAM_NAME) +
+                     " parameter is invalid");
+      }
+      leaseHolder = parameter.value();
+    } else if (parameter.key() == FORCE_DETACH_CMD_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      forceDetachCommand = parameter.value();
+    } else if (parameter.key() == LVM_THIN_POOL_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      const std::vector<std::string> names =
+        strings::split(parameter.value(), "/");
+      if (names.size() != 2 || names[0].empty() || names[1].empty() ||
+          (names[0] + names[1]).find_first_of(
+              prohibitedchars, 0, NUM_PROHIBITED) != string::npos) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(LVM_THIN_POOL_PARAM_NAME) +
+                     " parameter is invalid, must be <vg>/<thin pool>");
+      }
+      lvmThinPool = parameter.value();
+    } else if (parameter.key() == LVM_SNAPSHOT_PREFIX_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      if (parameter.value().empty() ||
+          strings::startsWith(parameter.value(), THIN_VOLUME_PREFIX) ||
+          parameter.value().find_first_of(
+              prohibitedchars, 0, NUM_PROHIBITED) != string::npos) {
+        return Error("DockerVolumeDriverIsolator " +
+                     std::string(LVM_SNAPSHOT_PREFIX_PARAM_NAME) +
+                     " parameter is invalid, must not be empty or start "
+                     "with " + THIN_VOLUME_PREFIX);
+      }
+      lvmSnapshotPrefix = parameter.value();
+    } else if (parameter.key() == NATIVE_BIND_ALLOWED_PARAM_NAME) {
+      LOG(INFO) << "parameter " << parameter.key() << ":" << parameter.value();
+
+      nativeBindAllowed.clear();
+      foreach (const std::string& directory,
+               strings::tokenize(parameter.value(), ",")) {
+        if (!strings::startsWith(directory, "/")) {
+          return Error("DockerVolumeDriverIsolator " +
+                       std::string(NATIVE_BIND_ALLOWED_PARAM_NAME) +
+                       " parameter is invalid, must list absolute paths");
+        }
+        nativeBindAllowed.push_back(directory);
+      }
+    }
+  }
+
+  // Aliases kept on one agent only would give a rescheduled task a
+  // blank volume, and strand the one holding its data.
+  if (!poolClasses.empty() && poolAliasDir.empty()) {
+    return Error("DockerVolumeDriverIsolator " +
+                 std::string(VOLUME_POOL_PARAM_NAME) + " parameter requires " +
+                 std::string(VOLUME_POOL_ALIAS_DIR_PARAM_NAME));
+  }
+
+  if (!leaseDir.empty() && leaseHolder.empty()) {
+    Try<std::string> hostname = net::hostname();
+    if (hostname.isError()) {
+      return Error("DockerVolumeDriverIsolator failed to determine the " +
+                   std::string(LEASE_HOLDER_PARAM_NAME) + ": " +
+                   hostname.error());
     }
+    leaseHolder = hostname.get();
+  }
+
+  Try<hashmap<std::string, DriverLimits>> limits =
+    DriverOperationScheduler::parse(driverLimitsParameter, defaultDriverLimits);
+  if (limits.isError()) {
+    return Error("DockerVolumeDriverIsolator " +
+                 std::string(DRIVER_LIMITS_PARAM_NAME) +
+                 " parameter is invalid: " + limits.error());
   }
+  driverLimits = limits.get();
 
   mountPbFilename = path::join(getMetaRootDir(mesosWorkingDir),
                                  DVDI_MOUNTLIST_FILENAME);
+  poolPbFilename = path::join(getMetaRootDir(mesosWorkingDir),
+                              DVDI_POOL_FILENAME);
   LOG(INFO) << "using " << mountPbFilename;
 
-  return new DockerVolumeDriverIsolator(parameters);
+  return new DockerVolumeDriverIsolator(parameters, driver);
 }
 
 DockerVolumeDriverIsolator::~DockerVolumeDriverIsolator()
 {
+  process::terminate(endpoints.get());
+  process::wait(endpoints.get());
+
+  if (reconciler.get() != NULL) {
+    process::terminate(reconciler.get());
+    process::wait(reconciler.get());
+  }
+
+  if (poolRefiller.get() != NULL) {
+    process::terminate(poolRefiller.get());
+    process::wait(poolRefiller.get());
+  }
+
+  if (flusher.get() != NULL) {
+    process::terminate(flusher.get());
+    process::wait(flusher.get());
+  }
+
+  if (leaseRenewer.get() != NULL) {
+    process::terminate(leaseRenewer.get());
+    process::wait(leaseRenewer.get());
+  }
+
+  // Join the workers while the state their jobs use still exists.
+  workers.reset();
+  syncers.reset();
+
   // Delete all global objects allocated by libprotobuf.
   google::protobuf::ShutdownProtobufLibrary();
 }
@@ -142,6 +548,23 @@ Future<Nothing> DockerVolumeDriverIsolator::recover(
 {
   LOG(INFO) << "DockerVolumeDriverIsolator recover() was called";
 
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // recover() holds the lock until infos is rebuilt, so the reconciler
+  // can never observe the state in between.
+  recovered = true;
+
+  if (volumePool.get() != NULL) {
+    Try<Nothing> poolRecovered = volumePool->recover();
+    if (poolRecovered.isError()) {
+      LOG(ERROR) << "Failed to recover the volume pool: "
+                 << poolRecovered.error();
+    }
+  }
+
   // Slave recovery is a feature of Mesos that allows task/executors
   // to keep running if a slave process goes down, AND
   // allows the slave process to reconnect with already running
@@ -163,23 +586,8 @@ Future<Nothing> DockerVolumeDriverIsolator::recover(
   multihashmap<std::string, process::Owned<ExternalMount>>
       originalContainerMounts;
 
-  // Recover the state.
-  //TODO: need public version of recover in checkpointing
-  LOG(INFO) << "dvdicheckpoint::recover() called";
-  Result<State> resultState =
-    mesos::internal::slave::state::recover(mesosWorkingDir, true);
-
-  State state = resultState.get();
-  LOG(INFO) << "dvdicheckpoint::recover() returned: " << state.errors;
-
-  if (state.errors != 0) {
-    LOG(INFO) << "recover state error:" << state.errors;
-    return Nothing();
-  }
-
-  // read container mounts from filesystem
-  std::ifstream ifs(mountPbFilename);
-
+  // The agent has already recovered its own checkpointed state, and
+  // passes what we need of it in states and orphans.
   if (!os::exists(mountPbFilename)) {
     LOG(INFO) << "No mount protobuf file exists at " << mountPbFilename
               << " so there are no mounts to recover";
@@ -189,42 +597,41 @@ Future<Nothing> DockerVolumeDriverIsolator::recover(
   LOG(INFO) << "Parsing mount protobuf file(" << mountPbFilename
             << ") in recover()";
 
-  ExternalMountList mountlist;
-  if( !mountlist.ParseFromIstream(&ifs) )
-  {
-    LOG(INFO) << "Invalid protobuf data contained within " << mountPbFilename;
+  // checkpoint() writes the list as a length prefixed record, and
+  // replaces the file atomically, so a parse failure is not a torn write,
+  // and there is nothing better to recover from.
+  Result<ExternalMountList> read =
+    ::protobuf::read<ExternalMountList>(mountPbFilename);
+  if (read.isError()) {
+    LOG(ERROR) << "Invalid protobuf data contained within "
+               << mountPbFilename << ", no mounts will be recovered: "
+               << read.error();
     return Nothing();
   }
 
+  // None for an empty file.
+  ExternalMountList mountlist;
+  if (read.isSome()) {
+    mountlist = read.get();
+  }
+
   for (int i = 0; i < mountlist.mount_size(); i++)
   {
-    ExternalMount mount = mountlist.mount(i);
-
-    std::string data;
-    bool bSerialize = mount.SerializeToString(&data);
-    LOG(INFO) << "External Mount: ";
-    LOG(INFO) << data;
+    const ExternalMount& mount = mountlist.mount(i);
 
-    if (bSerialize) {
-      if (containsProhibitedChars(mount.volumedriver())) {
-        LOG(ERROR) << "Volumedriver element in json contains an illegal "
-                   << "character, mount will be ignored";
-        mount.set_volumedriver(std::string(""));
-      }
-
-      if (containsProhibitedChars(mount.volumename())) {
-        LOG(ERROR) << "Volumename element in json contains an illegal "
-                   << "character, mount will be ignored";
-        mount.set_volumename(std::string(""));
-      }
+    VLOG(1) << "External Mount: " << mount.ShortDebugString();
 
-      if (!mount.containerid().empty() && !mount.volumename().empty()) {
-        LOG(INFO) << "Adding to legacyMounts: ";
-        LOG(INFO) << mount.SerializeAsString();
+    if (containsProhibitedChars(mount.volumedriver()) ||
+        containsProhibitedChars(mount.volumename())) {
+      LOG(ERROR) << "Volumedriver or volumename element of a recovered "
+                 << "mount contains an illegal character, mount will be "
+                 << "ignored";
+      continue;
+    }
 
-        originalContainerMounts.put(mount.containerid(),
-          process::Owned<ExternalMount>(&mount));
-      }
+    if (!mount.containerid().empty() && !mount.volumename().empty()) {
+      originalContainerMounts.put(mount.containerid(),
+        process::Owned<ExternalMount>(new ExternalMount(mount)));
     }
   }
 
@@ -246,39 +653,39 @@ Future<Nothing> DockerVolumeDriverIsolator::recover(
     legacyMounts.put(getExternalMountId(*(elem.second.get())), elem.second);
   }
 
-  foreach (const ContainerState& state, states)
-  {
-    if (originalContainerMounts.contains(state.container_id().value())) {
+  // Orphans are containers the agent no longer tracks but that are
+  // still running. The agent destroys them once recovery is done, which
+  // calls cleanup(), so their mounts are kept until then rather than
+  // pulled out from under them now.
+  hashset<ContainerID> containers = orphans;
+  foreach (const ContainerState& state, states) {
+    containers.insert(state.container_id());
+  }
 
-      // We found a task that is still running and has mounts.
-      LOG(INFO) << "Running container(" << state.container_id().value()
-                << ") re-identified on recover()";
-      LOG(INFO) << "State.directory is (" << state.directory() << ")";
+  foreach (const ContainerID& containerId, containers) {
+    // A container listed twice must not have its mounts counted twice.
+    if (infos.contains(containerId) ||
+        !originalContainerMounts.contains(containerId.value())) {
+      continue;
+    }
 
-      std::list<process::Owned<ExternalMount>> mountsForContainer =
-          originalContainerMounts.get(state.container_id().value());
+    // We found a task that is still running and has mounts.
+    LOG(INFO) << "Container(" << containerId.value() << ") "
+              << (orphans.contains(containerId) ? "orphaned" : "running")
+              << " with mounts re-identified on recover()";
 
-      for (const auto &iter : mountsForContainer) {
-        // Copy task element to rebuild infos.
-        infos.put(state.container_id(), iter);
-        ExternalMountID id = getExternalMountId(*iter);
-        LOG(INFO) << "Re-identified a preserved mount, id is " << id;
-        inUseMounts.put(id, iter);
-      }
-    }
-  }
+    std::list<process::Owned<ExternalMount>> mountsForContainer =
+        originalContainerMounts.get(containerId.value());
 
-  // Create ExternalMountList protobuf message to checkpoint
-  ExternalMountList inUseMountsProtobuf;
-  for( const auto &iter : inUseMounts) {
-    ExternalMount* mount = inUseMountsProtobuf.add_mount();
-    mount->CopyFrom(*(iter.second.get()));
+    for (const auto &iter : mountsForContainer) {
+      // Copy task element to rebuild infos.
+      infos.put(containerId, iter);
+      ExternalMountID id = getExternalMountId(*iter);
+      VLOG(1) << "Re-identified a preserved mount, id is " << id;
+      inUseMounts.put(id, iter);
+    }
   }
 
-  //checkpoint the dvdi mounts for persistence
-  mesos::internal::slave::state::checkpoint(mountPbFilename,
-      inUseMountsProtobuf);
-
   // We will now reduce legacyMounts to only the mounts that should be removed.
   // We will do this by deleting the mounts still in use.
   for( const auto &iter : inUseMounts) {
@@ -286,207 +693,903 @@ Future<Nothing> DockerVolumeDriverIsolator::recover(
   }
 
   // legacyMounts now contains only "orphan" mounts whose task is gone.
-  // We will attempt to unmount these.
+  // These are unmounted in the background, at the lowest priority, so
+  // that they do not hold up tasks starting after the agent restart.
+  std::vector<ExternalMount> orphanMounts;
   for (const auto &iter : legacyMounts) {
-    if (!unmount(*(iter.second.get()), "recover()")) {
-      return Failure("recover() failed during unmount attempt");
-    }
+    orphanMounts.push_back(*(iter.second.get()));
+  }
+
+  foreach (const std::vector<ExternalMount>& group,
+           groupByDriver(orphanMounts)) {
+    releaseInBackground(group, "recover()",
+                        DriverOperationScheduler::BACKGROUND);
   }
 
+  //checkpoint the dvdi mounts for persistence
+  checkpointInfos();
+
+  LOG(INFO) << "Recovered " << originalContainerMounts.size()
+            << " mount record(s), " << inUseMounts.size()
+            << " volume(s) still in use and " << orphanMounts.size()
+            << " orphaned, in " << stopwatch.elapsed();
+
   return Nothing();
 }
 
-// Attempts to unmount specified external mount, returns true on success.
-// Also returns true so long as DVDCLI is successfully invoked,
-// even if a non-zero return code occurs.
-bool DockerVolumeDriverIsolator::unmount(
-    const ExternalMount& em,
-    const std::string&   callerLabelForLogging ) const
-{
-  LOG(INFO) << em.SerializeAsString() << " is being unmounted on " <<
-    callerLabelForLogging;
-
-  if (system(NULL)) { // Is a command processor available?
-
-    LOG(INFO) << "Invoking " << DVDCLI_UNMOUNT_CMD << " "
-              << VOL_DRIVER_CMD_OPTION << em.volumedriver() << " "
-              << VOL_NAME_CMD_OPTION << em.volumename();
-
-    Try<string> retcode = os::shell("%s %s%s %s%s ",
-      DVDCLI_UNMOUNT_CMD,
-      VOL_DRIVER_CMD_OPTION,
-      em.volumedriver().c_str(),
-      VOL_NAME_CMD_OPTION,
-      em.volumename().c_str());
-
-    if (retcode.isError()) {
-      LOG(WARNING) << DVDCLI_UNMOUNT_CMD << " failed to execute on "
-                   << callerLabelForLogging
-                   << ", continuing on the assumption this volume was "
-                   << "manually unmounted previously "
-                   << retcode.error();
-    } else {
-      LOG(INFO) << DVDCLI_UNMOUNT_CMD << " returned " << retcode.get();
-    }
-  } else {
-    LOG(ERROR) << "failed to acquire a command processor for unmount on "
-               << callerLabelForLogging;
-    return false;
+VolumeDriver* DockerVolumeDriverIsolator::volumeDriver(
+    const std::string& name) const
+{
+  if (driverOverride.get() != NULL) {
+    return driverOverride.get();
   }
 
-  return true;
-}
+  if (name == NATIVE_LVM_DRIVER) {
+    return thinDriver.get();
+  }
 
-// Attempts to mount specified external mount, returns true on success.
-std::string DockerVolumeDriverIsolator::mount(
-    const ExternalMount& em,
-    const std::string&   callerLabelForLogging) const
-{
-  LOG(INFO) << em.SerializeAsString() << " is being mounted on " <<
-    callerLabelForLogging;
-
-  const std::string volumeDriver = em.volumedriver();
-  const std::string volumeName = em.volumename();
-  std::string mountpoint; // Return value init'd to empty.
-
-  if (system(NULL)) { // Is a command processor available?
-    LOG(INFO) << "Invoking " << DVDCLI_MOUNT_CMD << " "
-              << VOL_DRIVER_CMD_OPTION << em.volumedriver() << " "
-              << VOL_NAME_CMD_OPTION << em.volumename() << " "
-              << em.options();
-
-    Try<string> retcode = os::shell("%s %s%s %s%s %s",
-      DVDCLI_MOUNT_CMD,
-      VOL_DRIVER_CMD_OPTION,
-      em.volumedriver().c_str(),
-      VOL_NAME_CMD_OPTION,
-      em.volumename().c_str(),
-      em.options().c_str());
-
-    if (retcode.isError()) {
-      LOG(ERROR) << DVDCLI_MOUNT_CMD << " failed to execute on "
-                 << callerLabelForLogging
-                 << retcode.error();
-    } else {
-      if (strings::trim(retcode.get()).empty()) {
-        LOG(ERROR) << DVDCLI_MOUNT_CMD
-                   << " returned an empty mountpoint name";
-      } else {
-        mountpoint = strings::trim(retcode.get());
-        LOG(INFO) << DVDCLI_MOUNT_CMD << " returned mountpoint:"
-                  << mountpoint;
-      }
-    }
-  } else {
-    LOG(ERROR) << "Failed to acquire a command processor for unmount on "
-               << callerLabelForLogging;
+  if (NativeVolumeDriver::handles(name)) {
+    return nativeDriver.get();
   }
-  return mountpoint;
-}
 
-bool DockerVolumeDriverIsolator::containsProhibitedChars(
-    const std::string& s) const
-{
-  return (string::npos != s.find_first_of(prohibitedchars, 0, NUM_PROHIBITED));
+  // Every volume plugin is reached through dvdcli.
+  return dvdcliDriver.get();
 }
 
-// Prepare runs BEFORE a task is started
-// will check if the volume is already mounted and if not,
-// will mount the volume.
-// A container can ask for multiple mounts, but if
-// there are any problems parsing or mounting even one
-// mount, we want to exit with an error and no new
-// mounted volumes. Goal: make all mounts or none.
-Future<Option<ContainerPrepareInfo>> DockerVolumeDriverIsolator::prepare(
-  const ContainerID& containerId,
-  const ExecutorInfo& executorInfo,
-  const string& directory,
-  const Option<string>& user)
+std::vector<std::vector<ExternalMount>>
+DockerVolumeDriverIsolator::groupByDriver(
+    const std::vector<ExternalMount>& mounts)
 {
-  LOG(INFO) << "Preparing external storage for container: "
-            << stringify(containerId);
+  std::vector<std::vector<ExternalMount>> groups;
+  hashmap<std::string, size_t> groupIndex;
 
-  // Get things we need from task's environment in ExecutoInfo.
-  if (!executorInfo.command().has_environment()) {
-    // No environment means no external volume specification.
-    // Not an error, just nothing to do, so return None.
-    LOG(INFO) << "No environment specified for container ";
-    return None();
+  foreach (const ExternalMount& em, mounts) {
+    if (!groupIndex.contains(em.volumedriver())) {
+      groupIndex[em.volumedriver()] = groups.size();
+      groups.push_back(std::vector<ExternalMount>());
+    }
+    groups[groupIndex[em.volumedriver()]].push_back(em);
   }
 
-  // In the future we aspire to accepting a json mount list
-  // some un-used "scaffolding" is in place now for this
-  JSON::Object environment;
-  JSON::Array jsonVariables;
+  return groups;
+}
 
-  // We accept <environment-var-name>#, where # can be 1-9, saved in array[#].
-  // We also accept <environment-var-name>, saved in array[0].
-  static constexpr size_t ARRAY_SIZE = 10;
-  std::array<std::string, ARRAY_SIZE> deviceDriverNames;
-  std::array<std::string, ARRAY_SIZE> volumeNames;
-  std::array<std::string, ARRAY_SIZE> mountOptions;
+// Attempts to unmount the specified external mounts, returns true if
+// every unmount that went ahead succeeded.
+bool DockerVolumeDriverIsolator::unmountVolumes(
+    const std::vector<ExternalMount>& mounts,
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority,
+    const std::function<bool(const ExternalMount&)>& proceed)
+{
+  if (mounts.empty()) {
+    return true;
+  }
 
-  // Iterate through the environment variables,
-  // looking for the ones we need.
-  foreach (const auto &variable,
-           executorInfo.command().environment().variables()) {
-    JSON::Object variableObject;
-    variableObject.values["name"] = variable.name();
-    variableObject.values["value"] = variable.value();
-    jsonVariables.values.push_back(variableObject);
+  const std::string& driverName = mounts.front().volumedriver();
+  VolumeDriver* driver = volumeDriver(driverName);
 
-    if (strings::startsWith(variable.name(), VOL_NAME_ENV_VAR_NAME)) {
+  foreach (const ExternalMount& em, mounts) {
+    LOG(INFO) << em.SerializeAsString() << " is being unmounted on " <<
+      callerLabelForLogging;
+  }
 
-      if (containsProhibitedChars(variable.value())) {
-        LOG(ERROR) << "Environment variable " << variable.name()
-                   << " rejected because it's value contains "
-                   << "prohibited characters";
-        return Failure("prepare() failed due to illegal environment variable");
-      }
+  // A driver without batch support is sent one unmount at a time,
+  // each admitted by the scheduler on its own.
+  const size_t batchSize = driver->supportsBatch() ? mounts.size() : 1;
+  bool success = true;
 
-      const size_t prefixLength = strlen(VOL_NAME_ENV_VAR_NAME);
+  for (size_t first = 0; first < mounts.size(); first += batchSize) {
+    const size_t count = std::min(batchSize, mounts.size() - first);
 
-      if (variable.name().length() == prefixLength) {
-        volumeNames[0] = variable.value();
-      } else if (variable.name().length() == (prefixLength+1)) {
-        char digit = variable.name().data()[prefixLength];
+    scheduler->acquire(driverName, priority, count);
 
-        if (isdigit(digit)) {
-          size_t index =
-              std::atoi(variable.name().substr(prefixLength).c_str());
+    std::vector<ExternalMount> batch;
+    for (size_t i = first; i < first + count; i++) {
+      if (proceed && !proceed(mounts[i])) {
+        LOG(INFO) << "Unmount of " << mounts[i].volumename() << " on "
+                  << callerLabelForLogging << " was cancelled, "
+                  << "the volume is in use again";
+        continue;
+      }
 
-          if (index !=0) {
-            volumeNames[index] = variable.value();
-          }
+      // A volume whose cache could not be written back must stay
+      // attached, or the writes still in the cache are lost.
+      if (mounts[i].has_cache()) {
+        Try<Nothing> detached =
+          cacheTier->detach(mounts[i].cache(), mounts[i].mountpoint());
+        if (detached.isError()) {
+          LOG(ERROR) << "Unmount of " << mounts[i].volumename() << " on "
+                     << callerLabelForLogging << " skipped, its cache "
+                     << "could not be removed: " << detached.error();
+
+          std::lock_guard<std::mutex> lock(failedUnmountsMutex);
+          failedUnmounts[mounts[i].mountpoint()] = mounts[i];
+          success = false;
+          continue;
         }
       }
-      LOG(INFO) << "External volume name (" << variable.value()
-                << ") parsed from environment";
-    } else if (strings::startsWith(variable.name(), VOL_DRIVER_ENV_VAR_NAME)) {
 
-      if (containsProhibitedChars(variable.value())) {
-        LOG(ERROR) << "Environment variable " << variable.name()
-            << " rejected because it's value contains prohibited characters";
-        return Failure("prepare() failed due to illegal environment variable");
-      }
+      batch.push_back(mounts[i]);
+    }
 
-      const size_t prefixLength = strlen(VOL_DRIVER_ENV_VAR_NAME);
+    std::vector<Try<Nothing>> results;
+    if (batch.size() == 1) {
+      results.push_back(driver->unmount(batch.front()));
+    } else if (!batch.empty()) {
+      results = driver->unmountBatch(batch);
+    }
 
-      if (variable.name().length() == prefixLength) {
-        deviceDriverNames[0] = variable.value();
-      } else if (variable.name().length() == (prefixLength+1)) {
+    scheduler->release(driverName, count);
 
-        char digit = variable.name().data()[prefixLength];
+    for (size_t i = 0; i < batch.size(); i++) {
+      const ExternalMount& em = batch[i];
 
-        if (isdigit(digit)) {
-          size_t index =
-              std::atoi(variable.name().substr(prefixLength).c_str());
-          if (index !=0) {
-            deviceDriverNames[index] = variable.value();
-          }
+      if (results[i].isError()) {
+        LOG(WARNING) << "Unmount of " << em.volumename() << " failed on "
+                     << callerLabelForLogging
+                     << ", continuing on the assumption this volume was "
+                     << "manually unmounted previously: "
+                     << results[i].error();
+
+        // If that assumption is wrong the reconciler will find the mount
+        // still in the kernel mount table and can retry.
+        if (!em.mountpoint().empty()) {
+          std::lock_guard<std::mutex> lock(failedUnmountsMutex);
+          failedUnmounts[em.mountpoint()] = em;
         }
+
+        success = false;
+      } else {
+        destroyClone(em, driver);
+        releaseLease(em);
       }
-    } else if (strings::startsWith(variable.name(), VOL_OPTS_ENV_VAR_NAME)) {
+    }
+  }
+
+  return success;
+}
+
+// Attempts to mount the specified external mounts, returns the
+// mounted volumes, with an empty mountpoint for each mount that failed.
+std::vector<MountedVolume> DockerVolumeDriverIsolator::mountVolumes(
+    const std::vector<ExternalMount>& mounts,
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority,
+    std::vector<VolumeTiming>* mountTimings) const
+{
+  std::vector<MountedVolume> mounted(mounts.size());
+
+  if (mountTimings != nullptr) {
+    mountTimings->assign(mounts.size(), VolumeTiming());
+  }
+
+  if (mounts.empty()) {
+    return mounted;
+  }
+
+  const std::string& driverName = mounts.front().volumedriver();
+  VolumeDriver* driver = volumeDriver(driverName);
+
+  foreach (const ExternalMount& em, mounts) {
+    LOG(INFO) << em.SerializeAsString() << " is being mounted on " <<
+      callerLabelForLogging;
+  }
+
+  const size_t batchSize = driver->supportsBatch() ? mounts.size() : 1;
+
+  for (size_t first = 0; first < mounts.size(); first += batchSize) {
+    const size_t count = std::min(batchSize, mounts.size() - first);
+    const std::vector<ExternalMount> batch(
+        mounts.begin() + first, mounts.begin() + first + count);
+
+    const Duration queueWait = scheduler->acquire(driverName, priority, count);
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    std::vector<Try<MountedVolume>> results;
+    if (count == 1) {
+      results.push_back(driver->mount(batch.front()));
+    } else {
+      results = driver->mountBatch(batch);
+    }
+
+    scheduler->release(driverName, count);
+
+    if (mountTimings != nullptr) {
+      for (size_t i = 0; i < count; i++) {
+        (*mountTimings)[first + i].queueWait = queueWait;
+        (*mountTimings)[first + i].attach = stopwatch.elapsed();
+      }
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < count; i++) {
+      if (results[i].isError()) {
+        LOG(ERROR) << "Mount of " << batch[i].volumename() << " failed on "
+                   << callerLabelForLogging << ": " << results[i].error();
+        failed = true;
+      } else if (strings::trim(results[i].get().mountpoint).empty()) {
+        LOG(ERROR) << "Mount of " << batch[i].volumename()
+                   << " returned an empty mountpoint name";
+        failed = true;
+      } else {
+        mounted[first + i] = MountedVolume(
+            strings::trim(results[i].get().mountpoint),
+            results[i].get().cloned);
+        LOG(INFO) << "Mount of " << batch[i].volumename()
+                  << " returned mountpoint:" << mounted[first + i].mountpoint
+                  << (mounted[first + i].cloned ? ", as a new clone" : "");
+      }
+    }
+
+    if (failed) {
+      // The caller reverts what did get mounted, don't add to it.
+      break;
+    }
+  }
+
+  return mounted;
+}
+
+// Attempts to mount specified external mount, returns true on success.
+std::string DockerVolumeDriverIsolator::mount(
+    const ExternalMount& em,
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority) const
+{
+  return mountVolumes(
+      std::vector<ExternalMount>(1, em), callerLabelForLogging, priority)
+    .front().mountpoint;
+}
+
+void DockerVolumeDriverIsolator::syncInBackground(
+    const std::vector<std::string>& mountpoints)
+{
+  foreach (const std::string& mountpoint, mountpoints) {
+    if (syncing.contains(mountpoint)) {
+      continue;
+    }
+    syncing.insert(mountpoint);
+
+    syncers->submit([this, mountpoint]() {
+      Stopwatch stopwatch;
+      stopwatch.start();
+
+      Try<Nothing> sync = syncFilesystem(mountpoint);
+      if (sync.isError()) {
+        LOG(WARNING) << sync.error();
+      } else {
+        LOG(INFO) << "Synced " << mountpoint << " in " << stopwatch.elapsed();
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      syncing.erase(mountpoint);
+    });
+  }
+}
+
+void DockerVolumeDriverIsolator::flushVolumes()
+{
+  hashset<std::string> mountpoints;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (const auto &elem : infos) {
+      if (!elem.second->mountpoint().empty()) {
+        mountpoints.insert(elem.second->mountpoint());
+      }
+    }
+  }
+
+  hashmap<std::string, Bytes> written;
+  std::vector<std::string> busy;
+  foreach (const std::string& mountpoint, mountpoints) {
+    // Volumes without a block device, such as NFS, are not tracked.
+    Try<Bytes> bytes = bytesWritten(mountpoint);
+    if (bytes.isError()) {
+      continue;
+    }
+
+    written[mountpoint] = bytes.get();
+
+    // A counter that went backwards belongs to a new device.
+    if (lastBytesWritten.contains(mountpoint) &&
+        bytes.get() >= lastBytesWritten[mountpoint] &&
+        bytes.get() - lastBytesWritten[mountpoint] >= flushThreshold) {
+      busy.push_back(mountpoint);
+    }
+  }
+
+  // Volumes no longer mounted are dropped.
+  lastBytesWritten = written;
+
+  if (busy.empty()) {
+    return;
+  }
+
+  LOG(INFO) << "Syncing " << busy.size() << " volume(s) written more than "
+            << flushThreshold << " since the last check";
+
+  // A volume whose last sync is still running is not queued again.
+  std::lock_guard<std::mutex> lock(mutex);
+  syncInBackground(busy);
+}
+
+void DockerVolumeDriverIsolator::destroyClone(
+    const ExternalMount& em,
+    VolumeDriver* driver) const
+{
+  // A volume of the same name that was there before is never removed,
+  // even if it was asked for with fromsnapshot.
+  Option<std::string> policy =
+    findVolumeOption(em.options(), CLONE_POLICY_OPTION);
+  if (!em.cloned() || policy.isNone() || policy.get() != CLONE_DESTROY) {
+    return;
+  }
+
+  Try<Nothing> removed = driver->remove(em);
+  if (removed.isError()) {
+    LOG(ERROR) << "Failed to destroy clone " << em.volumename()
+               << ", it is left behind: " << removed.error();
+    return;
+  }
+
+  LOG(INFO) << "Destroyed clone " << em.volumename()
+            << " after its last unmount";
+}
+
+bool DockerVolumeDriverIsolator::leased(const ExternalMount& em) const
+{
+  // The pool attaches its volumes only to create them, before any task
+  // can ask for them, and takes no lease.
+  return leaseStore.get() != NULL &&
+         !NativeVolumeDriver::handles(em.volumedriver()) &&
+         em.containerid() != POOL_CONTAINER_ID;
+}
+
+static std::string leaseKey(const ExternalMount& em)
+{
+  return em.volumedriver() + "/" + em.volumename();
+}
+
+Try<Nothing> DockerVolumeDriverIsolator::acquireLease(const ExternalMount& em)
+{
+  if (!leased(em)) {
+    return Nothing();
+  }
+
+  Try<Option<Lease>> previous =
+    leaseStore->acquire(leaseKey(em), leaseHolder, leaseTtl);
+  if (previous.isError()) {
+    return Error(previous.error());
+  }
+
+  if (previous.get().isNone()) {
+    return Nothing();
+  }
+
+  // The previous holder stopped renewing, but may still have the
+  // volume attached, and must be fenced off before it is attached here.
+  LOG(WARNING) << "Taking over volume " << em.volumename() << " from "
+               << previous.get().get().holder << ", whose lease expired";
+
+  VolumeDriver* driver = volumeDriver(em.volumedriver());
+  scheduler->acquire(em.volumedriver(), DriverOperationScheduler::PREPARE);
+  Try<Nothing> detached = driver->forceDetach(em);
+  scheduler->release(em.volumedriver());
+
+  if (detached.isError()) {
+    releaseLease(em);
+    return Error("failed to force detach it from " +
+                 previous.get().get().holder + ": " + detached.error());
+  }
+
+  LOG(INFO) << "Force detached volume " << em.volumename() << " from "
+            << previous.get().get().holder;
+
+  return Nothing();
+}
+
+void DockerVolumeDriverIsolator::releaseLease(const ExternalMount& em)
+{
+  if (!leased(em)) {
+    return;
+  }
+
+  Try<Nothing> released = leaseStore->release(leaseKey(em), leaseHolder);
+  if (released.isError()) {
+    // It expires by itself, once it is no longer renewed.
+    LOG(WARNING) << "Failed to release the lease on volume "
+                 << em.volumename() << ": " << released.error();
+  }
+}
+
+void DockerVolumeDriverIsolator::renewLeases()
+{
+  hashmap<std::string, ExternalMount> attached;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!recovered) {
+      return;
+    }
+
+    for (const auto &elem : infos) {
+      attached[leaseKey(*elem.second)] = *elem.second;
+    }
+
+    for (const auto &elem : pendingUnmounts) {
+      attached[leaseKey(elem.second->mount)] = elem.second->mount;
+    }
+
+    // Volumes prepare() has taken the lease on, and is still mounting.
+    for (const auto &elem : pendingAttaches) {
+      if (elem.second->leased) {
+        attached[leaseKey(elem.second->mount)] = elem.second->mount;
+      }
+    }
+
+    std::lock_guard<std::mutex> failedLock(failedUnmountsMutex);
+    for (const auto &elem : failedUnmounts) {
+      attached[leaseKey(elem.second)] = elem.second;
+    }
+  }
+
+  foreach (const auto& elem, attached) {
+    if (!leased(elem.second)) {
+      continue;
+    }
+
+    Try<Nothing> renewed = leaseStore->renew(elem.first, leaseHolder, leaseTtl);
+    if (renewed.isError()) {
+      // Another agent may have taken the volume over and fenced it off,
+      // so writes to it from here are likely to fail.
+      LOG(ERROR) << "Failed to renew the lease on volume "
+                 << elem.second.volumename() << ": " << renewed.error();
+    }
+  }
+}
+
+void DockerVolumeDriverIsolator::refillPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!recovered) {
+      LOG(INFO) << "Skipping volume pool refill, recover() has not run yet";
+      return;
+    }
+
+    // The last refill may still be creating the volumes that are short.
+    if (poolRefilling) {
+      return;
+    }
+    poolRefilling = true;
+  }
+
+  // Creating and formatting volumes can take minutes, which must not be
+  // spent on a libprocess thread.
+  workers->submit([this]() {
+    foreach (const auto& shortfall, volumePool->shortfall()) {
+      createPoolVolumes(shortfall.first, shortfall.second);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    poolRefilling = false;
+  });
+}
+
+void DockerVolumeDriverIsolator::createPoolVolumes(
+    const PoolClass& poolClass,
+    size_t count)
+{
+  std::vector<ExternalMount> volumes;
+  std::vector<process::Owned<PendingAttach>> attaching;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The volumes are checkpointed while attached, so that they are
+    // unmounted by recover() should the agent go down meanwhile.
+    for (size_t i = 0; i < count; i++) {
+      process::Owned<ExternalMount> em(
+        Builder().setContainerId(POOL_CONTAINER_ID)
+                 .setVolumeDriver(poolClass.driver)
+                 .setVolumeName(VolumePool::generateName())
+                 .setOptions(poolClass.options())
+                 .build());
+      volumes.push_back(*em);
+
+      process::Owned<PendingAttach> pending(new PendingAttach());
+      pending->mount.CopyFrom(*em);
+      pendingAttaches[getExternalMountId(*em)] = pending;
+      attaching.push_back(pending);
+    }
+
+    checkpointInfos();
+  }
+
+  LOG(INFO) << "Creating " << volumes.size() << " volume(s) for pool "
+            << poolClass.key();
+
+  // The first mount creates and formats the volume, it is then
+  // detached until claimed.
+  const std::vector<MountedVolume> mounted = mountVolumes(
+      volumes, "refillPool()", DriverOperationScheduler::BACKGROUND);
+
+  std::vector<ExternalMount> created;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t i = 0; i < volumes.size(); i++) {
+      if (!mounted[i].mountpoint.empty()) {
+        volumes[i].set_mountpoint(mounted[i].mountpoint);
+        attaching[i]->mount.set_mountpoint(mounted[i].mountpoint);
+        created.push_back(volumes[i]);
+      }
+    }
+
+    checkpointInfos();
+  }
+
+  unmountVolumes(
+      created, "refillPool()", DriverOperationScheduler::BACKGROUND);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    foreach (const process::Owned<PendingAttach>& pending, attaching) {
+      pendingAttaches.erase(getExternalMountId(pending->mount));
+      pending->promise.set(Nothing());
+    }
+
+    checkpointInfos();
+  }
+
+  // A volume that could not be detached, and is left to the reconciler,
+  // may still be attached here and is not handed out.
+  size_t added = 0;
+  foreach (const ExternalMount& em, created) {
+    {
+      std::lock_guard<std::mutex> lock(failedUnmountsMutex);
+      if (failedUnmounts.contains(em.mountpoint())) {
+        LOG(WARNING) << "Volume " << em.volumename() << " is left out of "
+                     << "pool " << poolClass.key() << ", it failed to "
+                     << "unmount";
+        continue;
+      }
+    }
+
+    volumePool->add(poolClass, em.volumename());
+    added++;
+  }
+
+  LOG(INFO) << "Volume pool " << poolClass.key() << " gained "
+            << added << " of " << volumes.size()
+            << " volume(s) created";
+}
+
+Try<Option<VolumeCache>> DockerVolumeDriverIsolator::attachCache(
+    const ExternalMount& em,
+    const std::string& mountpoint) const
+{
+  Option<std::string> mode = findVolumeOption(em.options(), CACHE_OPTION);
+  if (mode.isNone()) {
+    return Option<VolumeCache>::none();
+  }
+
+  Bytes size = cacheSize;
+  Option<std::string> requested =
+    findVolumeOption(em.options(), CACHE_SIZE_OPTION);
+  if (requested.isSome()) {
+    size = Bytes::parse(requested.get()).get();
+  }
+
+  Try<VolumeCache> cache = cacheTier->attach(em, mountpoint, mode.get(), size);
+  if (cache.isError()) {
+    return Error(cache.error());
+  }
+
+  return Option<VolumeCache>(cache.get());
+}
+
+void DockerVolumeDriverIsolator::applyVolumeProfile(
+    const ExternalMount& em,
+    const std::string& mountpoint) const
+{
+  Option<std::string> name = findVolumeOption(em.options(), IO_PROFILE_OPTION);
+  if (name.isNone()) {
+    return;
+  }
+
+  // Validated in prepare(), but the record may predate a profile's removal.
+  Option<IoProfile> profile = findIoProfile(name.get());
+  if (profile.isNone()) {
+    LOG(WARNING) << "Unknown I/O profile " << name.get() << " for volume "
+                 << em.volumename() << " ignored";
+    return;
+  }
+
+  // The volume is usable without its profile, so a setting that cannot
+  // be applied is reported rather than failing the mount.
+  Try<Nothing> applied = applyIoProfile(profile.get(), mountpoint);
+  if (applied.isError()) {
+    LOG(WARNING) << "I/O profile " << name.get() << " only partly applied to "
+                 << em.volumename() << " at " << mountpoint << ": "
+                 << applied.error();
+  }
+}
+
+bool DockerVolumeDriverIsolator::containsProhibitedChars(
+    const std::string& s) const
+{
+  return (string::npos != s.find_first_of(prohibitedchars, 0, NUM_PROHIBITED));
+}
+
+bool DockerVolumeDriverIsolator::containsProhibitedOptionChars(
+    const std::string& options,
+    const std::string& driver) const
+{
+  if (!NativeVolumeDriver::handles(driver)) {
+    return containsProhibitedChars(options);
+  }
+
+  // The native drivers never pass options through a shell, and their
+  // sources are host paths and NFS exports.
+  return containsProhibitedChars(
+      strings::replace(strings::replace(options, "/", ""), ":", ""));
+}
+
+bool DockerVolumeDriverIsolator::isValidSubPath(const std::string& s) const
+{
+  if (s.empty()) {
+    return false;
+  }
+
+  // strings::split keeps empty tokens, so "a//b", "/a" and "a/"
+  // are all rejected by the empty component check.
+  foreach (const std::string& component,
+           strings::split(s, string(1, SUBPATH_SEPARATOR))) {
+    if (component.empty() || component == "." || component == ".." ||
+        containsProhibitedChars(component)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns true if path is root or lies under it. Both must have every
+// symlink resolved.
+static bool isUnder(const std::string& path, const std::string& root)
+{
+  return path == root || strings::startsWith(path, root + "/");
+}
+
+Try<std::string> DockerVolumeDriverIsolator::subPathSource(
+    const std::string& mountpoint,
+    const std::string& subpath) const
+{
+  const std::string source = path::join(mountpoint, subpath);
+
+  Result<std::string> root = os::realpath(mountpoint);
+  if (!root.isSome()) {
+    return Error("Failed to resolve " + mountpoint);
+  }
+
+  // Nothing is created until the part of the subpath that exists already
+  // is known to stay inside the volume.
+  std::string existing = mountpoint;
+  foreach (const std::string& component,
+           strings::split(subpath, string(1, SUBPATH_SEPARATOR))) {
+    if (!os::exists(path::join(existing, component))) {
+      break;
+    }
+    existing = path::join(existing, component);
+  }
+
+  Result<std::string> resolved = os::realpath(existing);
+  if (!resolved.isSome() || !isUnder(resolved.get(), root.get())) {
+    return Error(existing + " is outside of the volume");
+  }
+
+  Try<Nothing> mkdir = os::mkdir(source);
+  if (mkdir.isError()) {
+    return Error(mkdir.error());
+  }
+
+  resolved = os::realpath(source);
+  if (!resolved.isSome()) {
+    return Error("Failed to resolve " + source);
+  }
+
+  // The resolved path ends up on the bind command line, so it is held
+  // to the same rules as the subpath that was asked for.
+  if (resolved.get() == root.get() || !isUnder(resolved.get(), root.get()) ||
+      !isValidSubPath(resolved.get().substr(root.get().size() + 1))) {
+    return Error(source + " resolves to " + resolved.get() +
+                 ", which is not a subpath of the volume");
+  }
+
+  return resolved.get();
+}
+
+void DockerVolumeDriverIsolator::revertMounts(
+    const std::vector<process::Owned<ExternalMount>>& mounts,
+    const std::string& callerLabelForLogging)
+{
+  std::vector<ExternalMount> unmountList;
+  for (const auto &unmountme : mounts) {
+    unmountList.push_back(*unmountme);
+  }
+
+  foreach (const std::vector<ExternalMount>& group,
+           groupByDriver(unmountList)) {
+    if (!unmountVolumes(group, callerLabelForLogging,
+                        DriverOperationScheduler::PREPARE)) {
+      LOG(ERROR) << "During prepare() of a container requesting multiple "
+                 << "mounts, a mount failure occurred after making "
+                 << "at least one mount and a second failure occurred "
+                 << "while attempting to remove the earlier mount(s)";
+    }
+  }
+}
+
+static std::string accessModeName(const ExternalMount& em)
+{
+  return em.accessmode().empty() ? "default" : em.accessmode();
+}
+
+// Returns why requested can not use the attach made for inUse, a
+// mount of the same volume, if the options that shape the attach
+// differ.
+static Option<Error> attachConflict(
+    const ExternalMount& inUse,
+    const ExternalMount& requested)
+{
+  static const char* const options[] = {
+    IO_PROFILE_OPTION,
+    CACHE_OPTION,
+    CACHE_SIZE_OPTION
+  };
+
+  foreach (const char* option, options) {
+    Option<std::string> current = findVolumeOption(inUse.options(), option);
+    Option<std::string> wanted = findVolumeOption(requested.options(), option);
+    if (current != wanted) {
+      return Error("option " + std::string(option) + "=" +
+                   wanted.getOrElse("") + " does not match " +
+                   current.getOrElse("") + " in use");
+    }
+  }
+
+  return None();
+}
+
+// As above, and also checks that the access modes allow sharing. Any
+// number of ro mounts share one attach, as do default mounts, while
+// an rw mount shares with nothing.
+static Option<Error> sharingConflict(
+    const ExternalMount& inUse,
+    const ExternalMount& requested)
+{
+  if (requested.accessmode() == ACCESS_READ_WRITE ||
+      inUse.accessmode() == ACCESS_READ_WRITE) {
+    return Error("access mode rw is exclusive, and " +
+                 accessModeName(inUse) + " is in use");
+  }
+
+  if (requested.accessmode() != inUse.accessmode()) {
+    return Error("access mode " + accessModeName(requested) +
+                 " does not match " + accessModeName(inUse) + " in use");
+  }
+
+  return attachConflict(inUse, requested);
+}
+
+// Prepare runs BEFORE a task is started
+// will check if the volume is already mounted and if not,
+// will mount the volume.
+// A container can ask for multiple mounts, but if
+// there are any problems parsing or mounting even one
+// mount, we want to exit with an error and no new
+// mounted volumes. Goal: make all mounts or none.
+Future<Option<ContainerPrepareInfo>> DockerVolumeDriverIsolator::prepare(
+  const ContainerID& containerId,
+  const ExecutorInfo& executorInfo,
+  const string& directory,
+  const Option<string>& user)
+{
+  LOG(INFO) << "Preparing external storage for container: "
+            << stringify(containerId);
+
+  // Waiting for the lock, and for another prepare() attaching one of the
+  // same volumes, is part of the time storage added to the launch.
+  Stopwatch prepareStopwatch;
+  prepareStopwatch.start();
+
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // Get things we need from task's environment in ExecutoInfo.
+  if (!executorInfo.command().has_environment()) {
+    // No environment means no external volume specification.
+    // Not an error, just nothing to do, so return None.
+    LOG(INFO) << "No environment specified for container ";
+    return None();
+  }
+
+  // In the future we aspire to accepting a json mount list
+  // some un-used "scaffolding" is in place now for this
+  JSON::Object environment;
+  JSON::Array jsonVariables;
+
+  // We accept <environment-var-name>#, where # can be 1-9, saved in array[#].
+  // We also accept <environment-var-name>, saved in array[0].
+  static constexpr size_t ARRAY_SIZE = 10;
+  std::array<std::string, ARRAY_SIZE> deviceDriverNames;
+  std::array<std::string, ARRAY_SIZE> volumeNames;
+  std::array<std::string, ARRAY_SIZE> mountOptions;
+  std::array<std::string, ARRAY_SIZE> subPaths;
+
+  // Iterate through the environment variables,
+  // looking for the ones we need.
+  foreach (const auto &variable,
+           executorInfo.command().environment().variables()) {
+    JSON::Object variableObject;
+    variableObject.values["name"] = variable.name();
+    variableObject.values["value"] = variable.value();
+    jsonVariables.values.push_back(variableObject);
+
+    if (strings::startsWith(variable.name(), VOL_NAME_ENV_VAR_NAME)) {
+
+      // A value of <volumename>:<subpath> requests a subdirectory
+      // of the volume rather than the whole volume.
+      std::string volumeName = variable.value();
+      std::string subPath;
+      const size_t separator = volumeName.find(VOL_SUBPATH_SEPARATOR);
+
+      if (separator != string::npos) {
+        subPath = volumeName.substr(separator + 1);
+        volumeName = volumeName.substr(0, separator);
+
+        if (!isValidSubPath(subPath)) {
+          LOG(ERROR) << "Environment variable " << variable.name()
+                     << " rejected because it's subpath is not a valid "
+                     << "relative path";
+          return Failure(
+              "prepare() failed due to illegal environment variable");
+        }
+      }
+
+      if (containsProhibitedChars(volumeName)) {
+        LOG(ERROR) << "Environment variable " << variable.name()
+                   << " rejected because it's value contains "
+                   << "prohibited characters";
+        return Failure("prepare() failed due to illegal environment variable");
+      }
+
+      const size_t prefixLength = strlen(VOL_NAME_ENV_VAR_NAME);
+
+      if (variable.name().length() == prefixLength) {
+        volumeNames[0] = volumeName;
+        subPaths[0] = subPath;
+      } else if (variable.name().length() == (prefixLength+1)) {
+        char digit = variable.name().data()[prefixLength];
+
+        if (isdigit(digit)) {
+          size_t index =
+              std::atoi(variable.name().substr(prefixLength).c_str());
+
+          if (index !=0) {
+            volumeNames[index] = volumeName;
+            subPaths[index] = subPath;
+          }
+        }
+      }
+      LOG(INFO) << "External volume name (" << variable.value()
+                << ") parsed from environment";
+    } else if (strings::startsWith(variable.name(), VOL_DRIVER_ENV_VAR_NAME)) {
 
       if (containsProhibitedChars(variable.value())) {
         LOG(ERROR) << "Environment variable " << variable.name()
@@ -494,6 +1597,24 @@ Future<Option<ContainerPrepareInfo>> DockerVolumeDriverIsolator::prepare(
         return Failure("prepare() failed due to illegal environment variable");
       }
 
+      const size_t prefixLength = strlen(VOL_DRIVER_ENV_VAR_NAME);
+
+      if (variable.name().length() == prefixLength) {
+        deviceDriverNames[0] = variable.value();
+      } else if (variable.name().length() == (prefixLength+1)) {
+
+        char digit = variable.name().data()[prefixLength];
+
+        if (isdigit(digit)) {
+          size_t index =
+              std::atoi(variable.name().substr(prefixLength).c_str());
+          if (index !=0) {
+            deviceDriverNames[index] = variable.value();
+          }
+        }
+      }
+    } else if (strings::startsWith(variable.name(), VOL_OPTS_ENV_VAR_NAME)) {
+      // Validated below, once the driver of the volume is known.
       const size_t prefixLength = strlen(VOL_OPTS_ENV_VAR_NAME);
 
       if (variable.name().length() == prefixLength) {
@@ -521,14 +1642,16 @@ Future<Option<ContainerPrepareInfo>> DockerVolumeDriverIsolator::prepare(
 
   // requestedExternalMounts is all mounts requested by container.
   std::vector<process::Owned<ExternalMount>> requestedExternalMounts;
-  // unconnectedExternalMounts is the subset of those not already
-  // in use by another container.
-  std::vector<process::Owned<ExternalMount>> unconnectedExternalMounts;
-  // prevConnectedExternalMounts is the subset of those that are
-  // in use by another container.
-  std::vector<process::Owned<ExternalMount>> prevConnectedExternalMounts;
-
-  // Not using iterator because we access all 3 arrays using common index.
+  // backingExternalMounts holds one of them for each backing volume,
+  // even if several subpaths of it were requested.
+  std::vector<process::Owned<ExternalMount>> backingExternalMounts;
+  // volumeTimings records how each requested backing volume was made
+  // available, and requestedVolumes which environment variable index
+  // asked for it.
+  hashmap<ExternalMountID, VolumeTiming> volumeTimings;
+  std::vector<std::pair<size_t, ExternalMountID>> requestedVolumes;
+
+  // Not using iterator because we access all 4 arrays using common index.
   for (size_t i = 0; i < volumeNames.size(); i++) {
 
     if (volumeNames[i].empty()) {
@@ -541,113 +1664,749 @@ Future<Option<ContainerPrepareInfo>> DockerVolumeDriverIsolator::prepare(
       deviceDriverNames[i] = VOL_DRIVER_DEFAULT;
     }
 
+    if (containsProhibitedOptionChars(mountOptions[i], deviceDriverNames[i])) {
+      LOG(ERROR) << "Volume options for volume " << volumeNames[i]
+                 << " rejected because they contain prohibited characters";
+      return Failure("prepare() failed due to illegal environment variable");
+    }
+
+    Option<std::string> ioProfile =
+      findVolumeOption(mountOptions[i], IO_PROFILE_OPTION);
+    if (ioProfile.isSome() && findIoProfile(ioProfile.get()).isNone()) {
+      LOG(ERROR) << "Unknown I/O profile " << ioProfile.get()
+                 << " requested for volume " << volumeNames[i];
+      return Failure("prepare() failed due to unknown I/O profile " +
+                     ioProfile.get());
+    }
+
+    Option<std::string> cacheMode =
+      findVolumeOption(mountOptions[i], CACHE_OPTION);
+    if (cacheMode.isSome()) {
+      Option<std::string> size =
+        findVolumeOption(mountOptions[i], CACHE_SIZE_OPTION);
+
+      std::string error;
+      if (!cacheTier->enabled()) {
+        error = "no " + std::string(CACHE_VG_PARAM_NAME) + " is configured";
+      } else if (cacheMode.get() != CACHE_WRITETHROUGH &&
+                 cacheMode.get() != CACHE_WRITEBACK) {
+        error = "unknown cache mode " + cacheMode.get();
+      } else if (NativeVolumeDriver::handles(deviceDriverNames[i])) {
+        error = deviceDriverNames[i] + " volumes can not be cached";
+      } else if (size.isSome() && Bytes::parse(size.get()).isError()) {
+        error = "invalid cache size " + size.get();
+      }
+
+      if (!error.empty()) {
+        LOG(ERROR) << "Cache requested for volume " << volumeNames[i]
+                   << " rejected: " << error;
+        return Failure("prepare() failed due to invalid cache request: " +
+                       error);
+      }
+    }
+
+    Option<std::string> pooled =
+      findVolumeOption(mountOptions[i], POOLED_OPTION);
+
+    Option<std::string> snapshot =
+      findVolumeOption(mountOptions[i], FROM_SNAPSHOT_OPTION);
+    Option<std::string> clonePolicy =
+      findVolumeOption(mountOptions[i], CLONE_POLICY_OPTION);
+    if (snapshot.isSome() || clonePolicy.isSome()) {
+      std::string error;
+      if (snapshot.isNone() || snapshot.get().empty()) {
+        error = "no snapshot given to clone from";
+      } else if (pooled.isSome() && pooled.get() == "true") {
+        error = "pooled volumes can not be cloned";
+      } else if (deviceDriverNames[i] == NATIVE_LVM_DRIVER &&
+                 !thinDriver->enabled()) {
+        error = "no " + std::string(LVM_THIN_POOL_PARAM_NAME) +
+                " is configured";
+      } else if (deviceDriverNames[i] == NATIVE_LVM_DRIVER &&
+                 !thinDriver->snapshotAllowed(snapshot.get())) {
+        error = "snapshot " + snapshot.get() + " does not start with " +
+                lvmSnapshotPrefix;
+      } else if (clonePolicy.isSome() &&
+                 clonePolicy.get() != CLONE_KEEP &&
+                 clonePolicy.get() != CLONE_DESTROY) {
+        error = "unknown clone policy " + clonePolicy.get();
+      } else if (clonePolicy.isSome() && clonePolicy.get() == CLONE_DESTROY &&
+                 deviceDriverNames[i] != NATIVE_LVM_DRIVER) {
+        // Only native-lvm says whether a mount made the clone, and a
+        // volume that was there before must never be removed.
+        error = deviceDriverNames[i] + " clones can not be destroyed";
+      }
+
+      if (!error.empty()) {
+        LOG(ERROR) << "Clone requested for volume " << volumeNames[i]
+                   << " rejected: " << error;
+        return Failure("prepare() failed due to invalid clone request: " +
+                       error);
+      }
+    }
+    if (pooled.isSome() && pooled.get() == "true" &&
+        volumePool.get() == NULL) {
+      LOG(ERROR) << "Pooled volume " << volumeNames[i] << " requested, "
+                 << "but no " << VOLUME_POOL_PARAM_NAME << " is configured";
+      return Failure("prepare() failed, no volume pool is configured");
+    }
+
+    if (deviceDriverNames[i] == NATIVE_BIND_DRIVER &&
+        nativeBindAllowed.empty()) {
+      LOG(ERROR) << "Bind volume " << volumeNames[i] << " rejected, no "
+                 << NATIVE_BIND_ALLOWED_PARAM_NAME << " is configured";
+      return Failure("prepare() failed, no " +
+                     std::string(NATIVE_BIND_ALLOWED_PARAM_NAME) +
+                     " is configured");
+    }
+
+    // Reject unknown drivers now, before any volume gets attached.
+    if (driverOverride.get() == NULL &&
+        !NativeVolumeDriver::handles(deviceDriverNames[i]) &&
+        pluginRegistry->lookup(deviceDriverNames[i]).isNone()) {
+      LOG(ERROR) << "Volume driver " << deviceDriverNames[i]
+                 << " requested for volume " << volumeNames[i]
+                 << " is not an installed volume plugin";
+      return Failure("prepare() failed due to unknown volume driver " +
+                     deviceDriverNames[i]);
+    }
+
+    Option<std::string> accessMode =
+      findVolumeOption(mountOptions[i], ACCESS_MODE_OPTION);
+    if (accessMode.isSome() &&
+        accessMode.get() != ACCESS_READ_ONLY &&
+        accessMode.get() != ACCESS_READ_WRITE) {
+      LOG(ERROR) << "Unknown access mode " << accessMode.get()
+                 << " requested for volume " << volumeNames[i];
+      return Failure("prepare() failed due to unknown access mode " +
+                     accessMode.get());
+    }
+  }
+
+  // Pool volumes claimed for this container, given back if prepare()
+  // fails.
+  std::vector<PoolClaim> poolClaims;
+  auto returnPoolClaims = [&]() {
+    foreach (const PoolClaim& claim, poolClaims) {
+      volumePool->giveBack(claim);
+    }
+  };
+
+  // Pooled names are resolved once every volume has been validated, so
+  // that a rejected container claims no pool volume.
+  for (size_t i = 0; i < volumeNames.size(); i++) {
+
+    if (volumeNames[i].empty()) {
+      continue;
+    }
+
+    Option<std::string> pooled =
+      findVolumeOption(mountOptions[i], POOLED_OPTION);
+    if (pooled.isSome() && pooled.get() == "true") {
+      Try<std::string> resolved = volumePool->resolve(
+          deviceDriverNames[i], volumeNames[i], mountOptions[i], &poolClaims);
+      if (resolved.isError()) {
+        LOG(ERROR) << "Pooled volume " << volumeNames[i]
+                   << " rejected: " << resolved.error();
+        returnPoolClaims();
+        return Failure("prepare() failed to resolve pooled volume: " +
+                       resolved.error());
+      }
+
+      LOG(INFO) << "Pooled volume " << volumeNames[i] << " is "
+                << resolved.get();
+      volumeNames[i] = resolved.get();
+    }
+
+    Option<std::string> accessMode =
+      findVolumeOption(mountOptions[i], ACCESS_MODE_OPTION);
+
     process::Owned<ExternalMount> mount(
       Builder().setContainerId(stringify(containerId))
                .setVolumeDriver(deviceDriverNames[i])
                .setVolumeName(volumeNames[i])
                .setOptions(mountOptions[i])
+               .setSubPath(subPaths[i])
+               .setAccessMode(accessMode.getOrElse(""))
                .build()
       );
 
+    const ExternalMountID id = getExternalMountId(*mount);
+
+    requestedVolumes.push_back(std::make_pair(i, id));
+    if (!volumeTimings.contains(id)) {
+      volumeTimings[id].volumedriver = mount->volumedriver();
+      volumeTimings[id].volumename = mount->volumename();
+    }
+
     // Check for duplicates in environment.
     bool duplicateInEnv = false;
+    bool backingRequested = false;
     for (const auto &ent : requestedExternalMounts) {
 
-      if (getExternalMountId(*(ent.get())) ==
-             getExternalMountId(*(mount.get())) ) {
-        duplicateInEnv = true;
+      if (getExternalMountId(*(ent.get())) == id) {
+        // The subpaths of a volume share one attach, and so its mode.
+        Option<Error> conflict = attachConflict(*ent, *mount);
+        if (ent->accessmode() != mount->accessmode()) {
+          conflict = Error("access mode " + accessModeName(*mount) +
+                           " differs from " + accessModeName(*ent));
+        }
+
+        if (conflict.isSome()) {
+          LOG(ERROR) << "Requested mount(" << (*mount).SerializeAsString()
+                     << ") conflicts with another request for the same "
+                     << "volume: " << conflict.get().message;
+          returnPoolClaims();
+          return Failure("prepare() failed due to conflicting requests for "
+                         "volume " + mount->volumename() + ": " +
+                         conflict.get().message);
+        }
+
+        backingRequested = true;
+
+        if (ent->subpath() == mount->subpath()) {
+          duplicateInEnv = true;
+          break;
+        }
+      }
+    }
+
+    if (duplicateInEnv) {
+      LOG(INFO) << "Duplicate mount request("
+                << (*mount).SerializeAsString()
+                << ") in environment will be ignored";
+      continue;
+    }
+
+    requestedExternalMounts.push_back(mount);
+
+    if (backingRequested) {
+      // Another subpath of the same volume was requested above,
+      // the volume is mounted (or found in use) only once.
+      continue;
+    }
+
+    backingExternalMounts.push_back(mount);
+  }
+
+  // Volumes being attached by another prepare() are waited for, they
+  // are then found in infos, or attached here after all.
+  while (true) {
+    std::vector<ExternalMountID> attachedElsewhere;
+    std::list<Future<Nothing>> attachesInProgress;
+    for (const auto &iter : backingExternalMounts) {
+      const ExternalMountID id = getExternalMountId(*iter);
+      if (pendingAttaches.contains(id)) {
+        attachedElsewhere.push_back(id);
+        attachesInProgress.push_back(pendingAttaches[id]->promise.future());
+      }
+    }
+
+    if (attachesInProgress.empty()) {
+      break;
+    }
+
+    LOG(INFO) << "Waiting for " << attachesInProgress.size()
+              << " volume(s) being attached for another container";
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    lock.unlock();
+    foreach (const Future<Nothing>& attached, attachesInProgress) {
+      attached.await();
+    }
+    lock.lock();
+
+    foreach (const ExternalMountID& id, attachedElsewhere) {
+      volumeTimings[id].queueWait += stopwatch.elapsed();
+    }
+  }
+
+  // unusedExternalMounts is the subset of backing volumes not in use by
+  // another container, and unconnectedExternalMounts the subset of those
+  // that are not attached either.
+  std::vector<process::Owned<ExternalMount>> unusedExternalMounts;
+  std::vector<process::Owned<ExternalMount>> unconnectedExternalMounts;
+  // backingMountpoints holds the mountpoint of each requested backing
+  // volume, it is filled in for shared volumes now and for the
+  // unconnected ones as they are mounted.
+  hashmap<ExternalMountID, std::string> backingMountpoints;
+  // backingCaches holds the cache of each requested backing volume
+  // that has one.
+  hashmap<ExternalMountID, VolumeCache> backingCaches;
+  // backingClones holds the backing volumes the isolator created as
+  // clones.
+  hashset<ExternalMountID> backingClones;
+  // unmountsInProgress are background unmounts of requested volumes
+  // that had already started, we must let them finish before mounting.
+  std::list<Future<Nothing>> unmountsInProgress;
+  std::vector<ExternalMountID> unmountedFirst;
+  // reclaimed are pending unmounts of requested volumes that have not
+  // started, and are taken back instead.
+  std::vector<ExternalMountID> reclaimed;
+
+  for (const auto &mount : backingExternalMounts) {
+    const ExternalMountID id = getExternalMountId(*mount);
+
+    // Now check if another container is already using this same mount.
+    bool mountInUse = false;
+    for (const auto &ent : infos) {
+
+      if (getExternalMountId(*(ent.second.get())) == id) {
+        Option<Error> conflict = sharingConflict(*ent.second, *mount);
+        if (conflict.isSome()) {
+          LOG(ERROR) << "Requested mount(" << (*mount).SerializeAsString()
+                     << ") can not share the mount of container "
+                     << ent.first << ": " << conflict.get().message;
+          returnPoolClaims();
+          return Failure("prepare() failed, volume " + mount->volumename() +
+                         " can not be shared: " + conflict.get().message);
+        }
+
+        mountInUse = true;
+        backingMountpoints[id] = ent.second->mountpoint();
+        if (ent.second->has_cache()) {
+          backingCaches[id] = ent.second->cache();
+        }
+        if (ent.second->cloned()) {
+          backingClones.insert(id);
+        }
+        LOG(INFO) << "Requested mount(" << (*mount).SerializeAsString()
+                  << ") is already mounted by another container";
         break;
       }
     }
 
-    if (duplicateInEnv) {
-      LOG(INFO) << "Duplicate mount request("
-                << (*mount).SerializeAsString()
-                << ") in environment will be ignored";
-      continue;
+    if (!mountInUse) {
+      unusedExternalMounts.push_back(mount);
     }
+  }
 
-    requestedExternalMounts.push_back(mount);
+  // The volumes no container uses may be waiting to be unmounted in the
+  // background. They are only looked at once nothing can fail prepare()
+  // before the lock is let go, as taking one back cancels its unmount.
+  foreach (const process::Owned<ExternalMount>& mount, unusedExternalMounts) {
+    const ExternalMountID id = getExternalMountId(*mount);
 
-    // Now check if another container is already using this same mount.
     bool mountInUse = false;
-    for (const auto &ent : infos) {
-
-      if (getExternalMountId(*(ent.second.get())) ==
-            getExternalMountId(*(mount.get())) ) {
+    if (pendingUnmounts.contains(id)) {
+      process::Owned<PendingUnmount> pending = pendingUnmounts[id];
+
+      // A volume attached with other cache or profile options is let go
+      // and attached again with the ones requested. One whose unmount
+      // has not started is still attached, and is taken back rather
+      // than detached and attached again.
+      PendingUnmount::State queued = PendingUnmount::QUEUED;
+      if (attachConflict(pending->mount, *mount).isNone() &&
+          pending->state.compare_exchange_strong(
+              queued, PendingUnmount::CANCELLED)) {
+        reclaimed.push_back(id);
         mountInUse = true;
-        prevConnectedExternalMounts.push_back(ent.second);
+        backingMountpoints[id] = pending->mount.mountpoint();
+        if (pending->mount.has_cache()) {
+          backingCaches[id] = pending->mount.cache();
+        }
+        if (pending->mount.cloned()) {
+          backingClones.insert(id);
+        }
+        volumeTimings[id].status = VOLUME_RECLAIMED;
         LOG(INFO) << "Requested mount(" << (*mount).SerializeAsString()
-                  << ") is already mounted by another container";
-        break;
+                  << ") was pending unmount and has been taken back";
+      } else {
+        unmountsInProgress.push_back(pending->promise.future());
+        unmountedFirst.push_back(id);
       }
     }
 
     if (!mountInUse) {
+      volumeTimings[id].status = VOLUME_ATTACHED;
       unconnectedExternalMounts.push_back(mount);
     }
   }
 
+  // Builds the record of a requested mount for this container, once its
+  // backing volume is attached. Note: the record carries this container's
+  // id even when the backing volume was mounted by another container.
+  auto record = [&](const ExternalMount& requested) {
+    const ExternalMountID id = getExternalMountId(requested);
+
+    Builder builder;
+    builder.setContainerId(stringify(containerId))
+           .setVolumeDriver(requested.volumedriver())
+           .setVolumeName(requested.volumename())
+           .setOptions(requested.options())
+           .setMountPoint(backingMountpoints[id])
+           .setSubPath(requested.subpath())
+           .setAccessMode(requested.accessmode())
+           .setCloned(backingClones.contains(id));
+    if (backingCaches.contains(id)) {
+      builder.setCache(backingCaches[id]);
+    }
+    return process::Owned<ExternalMount>(builder.build());
+  };
+
+  // Volumes that are attached already are recorded for this container at
+  // once, so that they stay attached while the others are mounted without
+  // the lock, even if their other users go meanwhile. This includes the
+  // reclaimed ones, which are released again if prepare() fails.
+  hashset<ExternalMountID> recordedEarly;
+  for (const auto &iter : requestedExternalMounts) {
+    const ExternalMountID id = getExternalMountId(*iter);
+    if (backingMountpoints.contains(id)) {
+      recordedEarly.insert(id);
+      infos.put(containerId, record(*iter));
+    }
+  }
+
+  foreach (const ExternalMountID& id, reclaimed) {
+    pendingUnmounts.erase(id);
+  }
+
+  // The volumes attached here are registered before the lock is let go,
+  // so that no other prepare() attaches them as well.
+  std::vector<process::Owned<PendingAttach>> attaching;
+  for (const auto &iter : unconnectedExternalMounts) {
+    process::Owned<PendingAttach> pending(new PendingAttach());
+    pending->mount.CopyFrom(*iter);
+    pendingAttaches[getExternalMountId(*iter)] = pending;
+    attaching.push_back(pending);
+  }
+
+  if (!recordedEarly.empty()) {
+    checkpointInfos();
+  }
+
+  // Called with the lock held on every failure from here on. The volumes
+  // recorded early are let go as in cleanup(), which queues the unmount
+  // of the reclaimed ones again.
+  auto abandon = [&]() {
+    foreach (const process::Owned<PendingAttach>& pending, attaching) {
+      pendingAttaches.erase(getExternalMountId(pending->mount));
+      pending->promise.set(Nothing());
+    }
+
+    releaseContainer(
+        containerId, "prepare()", DriverOperationScheduler::CLEANUP);
+    checkpointInfos();
+    returnPoolClaims();
+  };
+
+  // The leases given up after a failure must not be renewed meanwhile.
+  auto stopRenewing = [&]() {
+    foreach (const process::Owned<PendingAttach>& pending, attaching) {
+      pending->leased = false;
+    }
+  };
+
+  // Driver calls are made without the lock, as the driver scheduler may
+  // have given its slots to workers that need it.
+  lock.unlock();
+
+  if (!unmountsInProgress.empty()) {
+    LOG(INFO) << "Waiting for " << unmountsInProgress.size()
+              << " unmount(s) in progress to finish before mounting";
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    foreach (const Future<Nothing>& unmounted, unmountsInProgress) {
+      unmounted.await();
+    }
+
+    foreach (const ExternalMountID& id, unmountedFirst) {
+      volumeTimings[id].queueWait += stopwatch.elapsed();
+    }
+  }
+
   // As we connect mounts we will build a list of successful mounts.
   // We need this because, if there is a failure, we need to unmount these.
   // The goal is we mount either ALL or NONE.
-  std::vector<process::Owned<ExternalMount>> successfulExternalMounts;
+  // The volumes of each driver are mounted together, in one batch if
+  // the driver supports it.
+  std::vector<ExternalMount> mountList;
   for (const auto &iter : unconnectedExternalMounts) {
-    std::string mountpoint = mount(*iter, "prepare()");
+    mountList.push_back(*iter);
+  }
+
+  // Take the lease on every volume before attaching any, so that a
+  // volume still held by another agent fails the container fast.
+  for (size_t i = 0; i < mountList.size(); i++) {
+    Try<Nothing> lease = acquireLease(mountList[i]);
+    if (lease.isError()) {
+      LOG(ERROR) << "Failed to take the lease on volume "
+                 << mountList[i].volumename() << ": " << lease.error();
+
+      stopRenewing();
+      for (size_t j = 0; j < i; j++) {
+        releaseLease(mountList[j]);
+      }
+
+      lock.lock();
+      abandon();
+      return Failure("prepare() failed to take the lease on volume " +
+                     mountList[i].volumename() + ": " + lease.error());
+    }
+
+    // The mount may take longer than the lease lasts, the leaseRenewer
+    // keeps it from here on.
+    attaching[i]->leased = true;
+  }
+
+  std::vector<process::Owned<ExternalMount>> successfulExternalMounts;
+  foreach (const std::vector<ExternalMount>& group, groupByDriver(mountList)) {
+    std::vector<VolumeTiming> groupTimings;
+    const std::vector<MountedVolume> mounted = mountVolumes(
+        group, "prepare()", DriverOperationScheduler::PREPARE, &groupTimings);
+
+    bool failed = false;
+    for (size_t i = 0; i < group.size(); i++) {
+      const std::string& mountpoint = mounted[i].mountpoint;
+      if (mountpoint.empty()) {
+        failed = true;
+        continue;
+      }
+
+      const ExternalMountID id = getExternalMountId(group[i]);
+      backingMountpoints[id] = mountpoint;
+      if (mounted[i].cloned) {
+        backingClones.insert(id);
+      }
 
-    if (!mountpoint.empty()) {
+      Stopwatch stopwatch;
+      stopwatch.start();
 
       // Need to construct a newExternalMount because we just
       // learned the mountpoint.
-      process::Owned<ExternalMount> newmount(
-        Builder().setContainerId(stringify(containerId))
-                 .setVolumeDriver(iter->volumedriver())
-                 .setVolumeName(iter->volumename())
-                 .setOptions(iter->options())
-                 .setMountPoint(mountpoint)
-                 .build()
-        );
-
-      successfulExternalMounts.push_back(newmount);
-    } else {
+      Builder builder;
+      builder.setContainerId(stringify(containerId))
+             .setVolumeDriver(group[i].volumedriver())
+             .setVolumeName(group[i].volumename())
+             .setOptions(group[i].options())
+             .setMountPoint(mountpoint)
+             .setCloned(mounted[i].cloned);
+
+      Try<Option<VolumeCache>> cache = attachCache(group[i], mountpoint);
+      if (cache.isError()) {
+        LOG(ERROR) << "Failed to cache volume " << group[i].volumename()
+                   << ": " << cache.error();
+        failed = true;
+      } else if (cache.get().isSome()) {
+        backingCaches[id] = cache.get().get();
+        builder.setCache(cache.get().get());
+      }
+
+      // The volume is reverted below if its cache failed, so it is
+      // recorded either way.
+      successfulExternalMounts.push_back(
+          process::Owned<ExternalMount>(builder.build()));
+
+      if (!cache.isError()) {
+        applyVolumeProfile(group[i], mountpoint);
+      }
+
+      volumeTimings[id].queueWait += groupTimings[i].queueWait;
+      volumeTimings[id].attach += groupTimings[i].attach + stopwatch.elapsed();
+    }
+
+    if (failed) {
       // Once any mount attempt fails, give up on whole list
       // and attempt to undo the mounts we already made.
       LOG(ERROR) << "Mount failed during prepare()";
-
-      for (const auto &unmountme : successfulExternalMounts) {
-
-        if (unmount(*unmountme, "prepare()-reverting mounts after failure")) {
-          LOG(ERROR) << "During prepare() of a container requesting multiple "
-                     << "mounts, a mount failure occurred after making "
-                     << "at least one mount and a second failure occurred "
-                     << "while attempting to remove the earlier mount(s)";
-          break;
+      stopRenewing();
+      revertMounts(successfulExternalMounts,
+                   "prepare()-reverting mounts after failure");
+
+      // The volumes that were attached gave up their lease when they
+      // were detached above.
+      foreach (const ExternalMount& em, mountList) {
+        if (!backingMountpoints.contains(getExternalMountId(em))) {
+          releaseLease(em);
         }
       }
+
+      lock.lock();
+      abandon();
       return Failure("prepare() failed during mount attempt");
     }
   }
 
+  // Bind mount requested subpaths into the sandbox. The bind mounts are
+  // made by the launcher inside the container's own mount namespace,
+  // so they go away with the container.
+  ContainerPrepareInfo prepareInfo;
+  std::vector<std::string> commands;
+  hashset<ExternalMountID> readOnly;
+  for (const auto &iter : requestedExternalMounts) {
+    const ExternalMountID id = getExternalMountId(*iter);
+    const std::string& mountpoint = backingMountpoints[id];
+
+    // A reader sees the shared mount read only, through a read only
+    // bind of it over itself in the container's mount namespace.
+    if (iter->accessmode() == ACCESS_READ_ONLY && !readOnly.contains(id)) {
+      readOnly.insert(id);
+
+      commands.push_back(
+          "mount -n --bind " + mountpoint + " " + mountpoint);
+      commands.push_back("mount -n -o remount,bind,ro " + mountpoint);
+    }
+
+    if (!iter->subpath().empty()) {
+      const std::string target = path::join(
+          directory, SANDBOX_VOLUMES_DIR, iter->volumename(), iter->subpath());
+
+      // The volume is shared by tenants, any of which may have replaced
+      // a directory on the subpath with a symlink out of the volume.
+      Try<std::string> source = subPathSource(mountpoint, iter->subpath());
+
+      Try<Nothing> mkdir = Nothing();
+      if (source.isSome()) {
+        mkdir = os::mkdir(target);
+      }
+
+      if (source.isError() || mkdir.isError()) {
+        const std::string error =
+          source.isError() ? source.error() : mkdir.error();
+        LOG(ERROR) << "Failed to create directory for subpath("
+                   << iter->subpath() << ") of volume("
+                   << iter->volumename() << "): " << error;
+        stopRenewing();
+        revertMounts(successfulExternalMounts,
+                     "prepare()-reverting mounts after failure");
+
+        lock.lock();
+        abandon();
+        return Failure("prepare() failed to create subpath directory: " +
+                       error);
+      }
+
+      LOG(INFO) << "Subpath " << source.get() << " will be bind mounted at "
+                << target;
+
+      commands.push_back("mount -n --bind " + source.get() + " " + target);
+
+      if (iter->accessmode() == ACCESS_READ_ONLY) {
+        commands.push_back("mount -n -o remount,bind,ro " + target);
+      }
+    }
+  }
+
+  lock.lock();
+
   // Note: infos has a record for each mount associated with this container
   // even if the mount is also used by another container.
-  for (const auto &iter : prevConnectedExternalMounts) {
-    infos.put(containerId, iter);
+  for (const auto &iter : requestedExternalMounts) {
+    if (!recordedEarly.contains(getExternalMountId(*iter))) {
+      infos.put(containerId, record(*iter));
+    }
   }
 
-  for (const auto &iter : successfulExternalMounts) {
-    infos.put(containerId, iter);
+  foreach (const process::Owned<PendingAttach>& pending, attaching) {
+    pendingAttaches.erase(getExternalMountId(pending->mount));
+    pending->promise.set(Nothing());
   }
 
-  // Create ExternalMountList protobuf message to checkpoint
-  ExternalMountList inUseMountsProtobuf;
-  for( const auto &iter : infos) {
-    ExternalMount* mount = inUseMountsProtobuf.add_mount();
-    mount->CopyFrom(*(iter.second.get()));
+  checkpointInfos();
+
+  foreach (const PoolClaim& claim, poolClaims) {
+    volumePool->keep(claim);
   }
-  mesos::internal::slave::state::checkpoint(mountPbFilename,
-    inUseMountsProtobuf);
 
-  return None();
+  if (requestedVolumes.empty()) {
+    return None();
+  }
+
+  // Tell the task, and the agent's endpoint, where its launch time went.
+  ContainerTiming timing;
+  timing.prepare = prepareStopwatch.elapsed();
+
+  Environment* taskEnvironment = prepareInfo.mutable_environment();
+  auto addVariable = [taskEnvironment](
+      const std::string& name, const std::string& value) {
+    Environment::Variable* variable = taskEnvironment->add_variables();
+    variable->set_name(name);
+    variable->set_value(value);
+  };
+
+  addVariable(PREPARE_MS_ENV_VAR_NAME,
+              stringify(static_cast<int64_t>(timing.prepare.ms())));
+
+  hashset<ExternalMountID> reported;
+  foreach (const auto& requested, requestedVolumes) {
+    const std::string suffix =
+      requested.first == 0 ? std::string() : stringify(requested.first);
+    const VolumeTiming& volume = volumeTimings[requested.second];
+
+    addVariable(VOL_STATUS_ENV_VAR_NAME + suffix, volume.status);
+    addVariable(VOL_QUEUE_WAIT_MS_ENV_VAR_NAME + suffix,
+                stringify(static_cast<int64_t>(volume.queueWait.ms())));
+    addVariable(VOL_ATTACH_MS_ENV_VAR_NAME + suffix,
+                stringify(static_cast<int64_t>(volume.attach.ms())));
+
+    if (!reported.contains(requested.second)) {
+      reported.insert(requested.second);
+      timing.volumes.push_back(volume);
+
+      LOG(INFO) << "Volume " << volume.volumename << " of container "
+                << containerId << " was " << volume.status << " after "
+                << volume.queueWait << " queued and " << volume.attach
+                << " attaching";
+    }
+  }
+
+  LOG(INFO) << "Prepared external storage for container " << containerId
+            << " in " << timing.prepare;
+
+  {
+    std::lock_guard<std::mutex> timingsLock(timingsMutex);
+    timings[containerId] = timing;
+  }
+
+  if (!commands.empty()) {
+    // Under systemd / is a shared mount, and the new mount namespace is
+    // a peer of the host's. Without this the binds, and the read only
+    // remounts, would propagate back to the host, where they outlive the
+    // container and keep its volumes busy.
+    prepareInfo.add_commands()->set_value("mount -n --make-rslave /");
+
+    foreach (const std::string& command, commands) {
+      prepareInfo.add_commands()->set_value(command);
+    }
+
+    prepareInfo.set_namespaces(CLONE_NEWNS);
+  }
+
+  return prepareInfo;
+}
+
+JSON::Object DockerVolumeDriverIsolator::containerTimings()
+{
+  std::lock_guard<std::mutex> lock(timingsMutex);
+
+  JSON::Object result;
+
+  foreachpair (const ContainerID& containerId,
+               const ContainerTiming& timing,
+               timings) {
+    JSON::Object container;
+    container.values["prepare_secs"] = JSON::Number(timing.prepare.secs());
+
+    JSON::Array volumes;
+    foreach (const VolumeTiming& volume, timing.volumes) {
+      JSON::Object entry;
+      entry.values["driver"] = volume.volumedriver;
+      entry.values["volume"] = volume.volumename;
+      entry.values["status"] = volume.status;
+      entry.values["queue_wait_secs"] = JSON::Number(volume.queueWait.secs());
+      entry.values["attach_secs"] = JSON::Number(volume.attach.secs());
+      volumes.values.push_back(entry);
+    }
+    container.values["volumes"] = volumes;
+
+    result.values[containerId.value()] = container;
+  }
+
+  return result;
 }
 
 Future<ContainerLimitation> DockerVolumeDriverIsolator::watch(
@@ -688,54 +2447,417 @@ Future<Nothing> DockerVolumeDriverIsolator::cleanup(
     const ContainerID& containerId)
 {
   //    1. Get driver name and volume list from infos.
-  //    2. Iterate list and perform unmounts.
+  //    2. Iterate list and queue unmounts.
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  {
+    std::lock_guard<std::mutex> timingsLock(timingsMutex);
+    timings.erase(containerId);
+  }
 
   if (!infos.contains(containerId)) {
     return Nothing();
   }
 
+  std::list<Future<Nothing>> unmounts = releaseContainer(
+      containerId, "cleanup()", DriverOperationScheduler::CLEANUP);
+
+  checkpointInfos();
+
+  return collect(unmounts)
+    .then([]() { return Nothing(); });
+}
+
+std::list<Future<Nothing>> DockerVolumeDriverIsolator::releaseContainer(
+    const ContainerID& containerId,
+    const std::string& callerLabelForLogging,
+    DriverOperationScheduler::Priority priority)
+{
+  std::list<Future<Nothing>> unmounts;
+
+  if (!infos.contains(containerId)) {
+    return unmounts;
+  }
+
   std::list<process::Owned<ExternalMount>> mountsList =
       infos.get(containerId);
   // mountList now contains all the mounts used by this container.
 
   // Note: it is possible that some of these mounts are
-  // also used by other tasks.
+  // also used by other tasks, and that this container uses
+  // several subpaths of the same backing volume.
+  hashset<ExternalMountID> released;
+  std::vector<ExternalMount> unmountList;
   for( const auto &iter : mountsList) {
-    size_t mountCount = 0;
+    const ExternalMountID id = getExternalMountId(*iter);
+
+    if (released.contains(id)) {
+      continue;
+    }
+    released.insert(id);
 
+    bool inUseElsewhere = false;
     for (const auto &elem : infos) {
       // elem.second is ExternalMount.
 
-      if (getExternalMountId(*iter) ==
-        getExternalMountId(*(elem.second.get()))) {
-        if( ++mountCount > 1) {
-           break; // As soon as we find two users we can quit.
-        }
+      if (elem.first != containerId &&
+          id == getExternalMountId(*(elem.second.get()))) {
+        inUseElsewhere = true;
+        break; // As soon as we find another user we can quit.
       }
     }
 
-    if (1 == mountCount) {
+    if (!inUseElsewhere) {
       // This container was the only, or last, user of this mount.
-
-      if (!unmount(*iter, "cleanup()")) {
-        return Failure("cleanup() failed during unmount attempt");
-      }
+      unmountList.push_back(*iter);
     }
   }
 
   // Remove all this container's mounts from infos.
   infos.remove(containerId);
 
+  // Write back dirty data now, in parallel across the volumes, so the
+  // unmount only has what is written from here on left to flush.
+  std::vector<std::string> mountpoints;
+  foreach (const ExternalMount& em, unmountList) {
+    if (!em.mountpoint().empty()) {
+      mountpoints.push_back(em.mountpoint());
+    }
+  }
+  syncInBackground(mountpoints);
+
+  // Unmounts wait behind the mounts of tasks being launched.
+  foreach (const std::vector<ExternalMount>& group,
+           groupByDriver(unmountList)) {
+    unmounts.push_back(
+        releaseInBackground(group, callerLabelForLogging, priority));
+  }
+
+  return unmounts;
+}
+
+Future<Nothing> DockerVolumeDriverIsolator::releaseInBackground(
+    const std::vector<ExternalMount>& mounts,
+    const std::string& callerLabelForLogging,
+    DriverOperationScheduler::Priority priority)
+{
+  std::vector<process::Owned<PendingUnmount>> pendings;
+  std::list<Future<Nothing>> futures;
+
+  foreach (const ExternalMount& em, mounts) {
+    process::Owned<PendingUnmount> pending(new PendingUnmount());
+    pending->mount.CopyFrom(em);
+    pendingUnmounts[getExternalMountId(em)] = pending;
+    pendings.push_back(pending);
+    futures.push_back(pending->promise.future());
+  }
+
+  const std::string label = callerLabelForLogging;
+
+  workers->submit([this, mounts, pendings, label, priority]() {
+    // Checked once the scheduler admits the unmount, as prepare()
+    // may have taken a volume back while we were queued.
+    size_t index = 0;
+    unmountVolumes(mounts, label, priority,
+        [pendings, &index](const ExternalMount&) {
+      PendingUnmount::State queued = PendingUnmount::QUEUED;
+      return pendings[index++]->state.compare_exchange_strong(
+          queued, PendingUnmount::STARTED);
+    });
+
+    bool changed = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      foreach (const process::Owned<PendingUnmount>& pending, pendings) {
+        const ExternalMountID id = getExternalMountId(pending->mount);
+
+        if (pendingUnmounts.contains(id) &&
+            pendingUnmounts[id].get() == pending.get()) {
+          pendingUnmounts.erase(id);
+          changed = true;
+        }
+      }
+
+      if (changed) {
+        checkpointInfos();
+      }
+    }
+
+    foreach (const process::Owned<PendingUnmount>& pending, pendings) {
+      pending->promise.set(Nothing());
+    }
+  });
+
+  return collect(futures)
+    .then([]() { return Nothing(); });
+}
+
+void DockerVolumeDriverIsolator::checkpointInfos() const
+{
   // Create ExternalMountList protobuf message to checkpoint
   ExternalMountList inUseMountsProtobuf;
   for( const auto &iter : infos) {
     ExternalMount* mount = inUseMountsProtobuf.add_mount();
     mount->CopyFrom(*(iter.second.get()));
   }
+  for( const auto &iter : pendingUnmounts) {
+    ExternalMount* mount = inUseMountsProtobuf.add_mount();
+    mount->CopyFrom(iter.second->mount);
+  }
+  for( const auto &iter : pendingAttaches) {
+    ExternalMount* mount = inUseMountsProtobuf.add_mount();
+    mount->CopyFrom(iter.second->mount);
+  }
   mesos::internal::slave::state::checkpoint(mountPbFilename,
     inUseMountsProtobuf);
+}
 
-  return Nothing();
+// Mountpoints returned by dvdcli may carry a trailing separator,
+// the kernel mount table never does.
+static std::string normalizeMountPoint(const std::string& mountpoint)
+{
+  return strings::remove(mountpoint, "/", strings::SUFFIX);
+}
+
+void DockerVolumeDriverIsolator::reconcile()
+{
+  // Snapshot the records under the lock, the mount table is read and
+  // compared without holding it.
+  hashmap<std::string, ExternalMount> trackedMounts;
+  hashmap<std::string, ExternalMount> releasedMounts;
+  hashset<std::string> releasingMounts;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!recovered) {
+      LOG(INFO) << "Skipping reconcile, recover() has not run yet";
+      return;
+    }
+
+    for (const auto &elem : infos) {
+      if (!elem.second->mountpoint().empty()) {
+        trackedMounts[normalizeMountPoint(elem.second->mountpoint())] =
+          *(elem.second.get());
+      }
+    }
+
+    for (const auto &elem : pendingUnmounts) {
+      releasingMounts.insert(
+          normalizeMountPoint(elem.second->mount.mountpoint()));
+    }
+
+    std::lock_guard<std::mutex> failedLock(failedUnmountsMutex);
+    for (const auto &elem : failedUnmounts) {
+      releasedMounts[normalizeMountPoint(elem.first)] = elem.second;
+    }
+  }
+
+  // Parse the kernel mount table once into an index of mount targets.
+  Try<fs::MountInfoTable> table = fs::MountInfoTable::read();
+  if (table.isError()) {
+    LOG(ERROR) << "Reconcile failed to read the mount table: "
+               << table.error();
+    return;
+  }
+
+  hashset<std::string> kernelMounts;
+  foreach (const fs::MountInfoTable::Entry& entry, table.get().entries) {
+    kernelMounts.insert(entry.target);
+  }
+
+  // Missing: we believe these are mounted, the kernel does not.
+  std::vector<ExternalMount> missing;
+  for (const auto &elem : trackedMounts) {
+    if (!kernelMounts.contains(elem.first)) {
+      LOG(WARNING) << "Reconcile found " << elem.second.volumename()
+                   << " missing from the mount table at " << elem.first;
+      missing.push_back(elem.second);
+    }
+  }
+
+  // Leaked: we released these, but the kernel still has them mounted.
+  std::vector<ExternalMount> leaked;
+  std::vector<std::string> released;
+  for (const auto &elem : releasedMounts) {
+    if (trackedMounts.contains(elem.first)) {
+      // In use again by a newer container.
+      released.push_back(elem.second.mountpoint());
+    } else if (kernelMounts.contains(elem.first)) {
+      LOG(WARNING) << "Reconcile found " << elem.second.volumename()
+                   << " still mounted at " << elem.first
+                   << " after a failed unmount";
+      leaked.push_back(elem.second);
+    } else {
+      released.push_back(elem.second.mountpoint());
+    }
+  }
+
+  // Volumes under the default and native mount roots that we have no
+  // record of are reported, but never touched, they may belong to
+  // another user of the same volume driver.
+  size_t untracked = 0;
+  foreach (const std::string& target, kernelMounts) {
+    if ((strings::startsWith(target, REXRAY_MOUNT_PREFIX) ||
+         strings::startsWith(target, NATIVE_MOUNT_PREFIX)) &&
+        !trackedMounts.contains(target) &&
+        !releasedMounts.contains(target) &&
+        !releasingMounts.contains(target)) {
+      LOG(WARNING) << "Reconcile found untracked volume mount at " << target;
+      untracked++;
+    }
+  }
+
+  LOG(INFO) << "Reconcile compared " << trackedMounts.size()
+            << " mount(s) against " << kernelMounts.size()
+            << " mount table entries: " << missing.size() << " missing, "
+            << leaked.size() << " leaked, " << untracked << " untracked";
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  {
+    std::lock_guard<std::mutex> failedLock(failedUnmountsMutex);
+    foreach (const std::string& mountpoint, released) {
+      failedUnmounts.erase(mountpoint);
+    }
+  }
+
+  if (!reconcileRepair) {
+    return;
+  }
+
+  // Each repair first checks, under the lock, that the records have not
+  // changed since the snapshot. Driver calls are made on the workers, at
+  // background priority, so they never hold up prepare() or cleanup().
+  size_t repairs = 0;
+  bool changed = false;
+
+  for (const auto &em : leaked) {
+    if (repairs >= reconcileBatchSize) {
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> failedLock(failedUnmountsMutex);
+      if (!failedUnmounts.contains(em.mountpoint())) {
+        continue;
+      }
+      failedUnmounts.erase(em.mountpoint());
+    }
+
+    const ExternalMountID id = getExternalMountId(em);
+
+    bool inUse = pendingUnmounts.contains(id) || pendingAttaches.contains(id);
+    for (const auto &elem : infos) {
+      if (getExternalMountId(*(elem.second.get())) == id) {
+        inUse = true;
+        break;
+      }
+    }
+
+    if (!inUse) {
+      // Released like any other unmount, so prepare() can still take
+      // the volume back.
+      repairs++;
+      releaseInBackground(std::vector<ExternalMount>(1, em), "reconcile()",
+                          DriverOperationScheduler::BACKGROUND);
+      changed = true;
+    }
+  }
+
+  for (const auto &em : missing) {
+    if (repairs >= reconcileBatchSize) {
+      break;
+    }
+
+    const ExternalMountID id = getExternalMountId(em);
+
+    bool inUse = false;
+    for (const auto &elem : infos) {
+      if (getExternalMountId(*(elem.second.get())) == id) {
+        inUse = true;
+        break;
+      }
+    }
+
+    if (!inUse) {
+      continue;
+    }
+
+    // The driver would mount the origin without its cache.
+    if (em.has_cache()) {
+      LOG(WARNING) << "Reconcile will not remount " << em.volumename()
+                   << ", its cache " << em.cache().device()
+                   << " must be restored by hand";
+      continue;
+    }
+
+    // A remount queued on an earlier pass may not have run yet.
+    if (remounting.contains(id)) {
+      continue;
+    }
+
+    repairs++;
+    remounting.insert(id);
+
+    // The driver queue may be long at background priority, which is no
+    // place for the reconciler's libprocess thread.
+    workers->submit([this, em]() { remount(em); });
+  }
+
+  if (changed) {
+    checkpointInfos();
+  }
+
+  if (repairs > 0) {
+    LOG(INFO) << "Reconcile made " << repairs << " repair(s)";
+  }
+}
+
+void DockerVolumeDriverIsolator::remount(const ExternalMount& em)
+{
+  const ExternalMountID id = getExternalMountId(em);
+
+  std::string mountpoint =
+    mount(em, "reconcile()", DriverOperationScheduler::BACKGROUND);
+  if (!mountpoint.empty()) {
+    applyVolumeProfile(em, mountpoint);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  remounting.erase(id);
+
+  if (mountpoint.empty()) {
+    LOG(ERROR) << "Reconcile failed to remount " << em.volumename();
+    return;
+  }
+
+  // The last user may have gone while we were mounting.
+  bool inUse = false;
+  for (const auto &elem : infos) {
+    if (getExternalMountId(*(elem.second.get())) == id) {
+      inUse = true;
+      elem.second->set_mountpoint(mountpoint);
+    }
+  }
+
+  if (!inUse) {
+    if (pendingUnmounts.contains(id) || pendingAttaches.contains(id)) {
+      return;
+    }
+
+    ExternalMount remounted(em);
+    remounted.set_mountpoint(mountpoint);
+    releaseInBackground(std::vector<ExternalMount>(1, remounted),
+                        "reconcile()",
+                        DriverOperationScheduler::BACKGROUND);
+  } else if (mountpoint == em.mountpoint()) {
+    return;
+  }
+
+  checkpointInfos();
 }
 
 static Isolator* createDockerVolumeDriverIsolator(const Parameters& parameters)
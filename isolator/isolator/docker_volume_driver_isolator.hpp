@@ -19,36 +19,51 @@
 
 #ifndef SRC_DOCKER_VOLUME_DRIVER_ISOLATOR_HPP_
 #define SRC_DOCKER_VOLUME_DRIVER_ISOLATOR_HPP_
+#include <atomic>
+#include <functional>
 #include <iostream>
-#include <boost/functional/hash.hpp>
+#include <list>
+#include <mutex>
+#include <vector>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+
 #include <mesos/mesos.hpp>
 
 #include <process/future.hpp>
 #include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <stout/bytes.hpp>
+#include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/multihashmap.hpp>
 #include <stout/protobuf.hpp>
 #include <stout/try.hpp>
 
-#include <slave/flags.hpp>
 #include <slave/containerizer/isolator.hpp>
+#include <slave/flags.hpp>
 
+#include "cache_tier.hpp"
+#include "driver_scheduler.hpp"
+#include "http_endpoints.hpp"
 #include "interface.hpp"
-using namespace emccode::isolator::mount;
-
+#include "io_profile.hpp"
+#include "lease_store.hpp"
+#include "mount_utils.hpp"
+#include "periodic_task.hpp"
+#include "plugin_registry.hpp"
+#include "thin_volume_driver.hpp"
+#include "volume_driver.hpp"
+#include "volume_pool.hpp"
+#include "work_queue.hpp"
 
 namespace mesos {
 namespace slave {
 
 static constexpr char REXRAY_MOUNT_PREFIX[]       = "/var/lib/rexray/volumes/";
-static constexpr char DVDCLI_MOUNT_CMD[]          = "/usr/bin/dvdcli mount";
-static constexpr char DVDCLI_UNMOUNT_CMD[]        = "/usr/bin/dvdcli unmount";
-
-static constexpr char VOL_NAME_CMD_OPTION[]       = "--volumename=";
-static constexpr char VOL_DRIVER_CMD_OPTION[]     = "--volumedriver=";
-static constexpr char VOL_OPTS_CMD_OPTION[]       = "--volumeopts=";
 static constexpr char VOL_DRIVER_DEFAULT[]        = "rexray";
 
 static constexpr char VOL_NAME_ENV_VAR_NAME[]     = "DVDI_VOLUME_NAME";
@@ -56,20 +71,159 @@ static constexpr char VOL_DRIVER_ENV_VAR_NAME[]   = "DVDI_VOLUME_DRIVER";
 static constexpr char VOL_OPTS_ENV_VAR_NAME[]     = "DVDI_VOLUME_OPTS";
 static constexpr char JSON_VOLS_ENV_VAR_NAME[]    = "DVDI_VOLS_JSON_ARRAY";
 
+// A volume name of the form <volumename>:<subpath> asks for only the
+// subpath subdirectory of the volume. The subdirectory is bind mounted
+// at <sandbox>/volumes/<volumename>/<subpath>.
+static constexpr char VOL_SUBPATH_SEPARATOR       = ':';
+static constexpr char SUBPATH_SEPARATOR           = '/';
+static constexpr char SANDBOX_VOLUMES_DIR[]       = "volumes";
+
 //TODO this is temporary until the working_dir is exposed by mesosphere dev
 static constexpr char DVDI_MOUNTLIST_DEFAULT_DIR[]= "/tmp/mesos/";
 static constexpr char DVDI_MOUNTLIST_FILENAME[]   = "dvdimounts.pb";
+static constexpr char DVDI_POOL_FILENAME[]        = "dvdipool.pb";
 static constexpr char DVDI_WORKDIR_PARAM_NAME[]   = "work_dir";
 
 //TODO this is temporary until the working_dir is exposed by mesosphere dev
 static constexpr char DEFAULT_WORKING_DIR[]       = "/tmp/mesos";
 
+// The reconciler compares the mount records against the kernel mount
+// table every reconcile_interval (0 disables it). By default it only
+// reports differences, reconcile_repair=true lets it remount missing
+// mounts and retry failed unmounts, at most reconcile_batch_size per pass.
+static constexpr char RECONCILE_INTERVAL_PARAM_NAME[] = "reconcile_interval";
+static constexpr char RECONCILE_REPAIR_PARAM_NAME[]   = "reconcile_repair";
+static constexpr char RECONCILE_BATCH_PARAM_NAME[]    = "reconcile_batch_size";
+static constexpr char RECONCILE_INTERVAL_DEFAULT[]    = "5mins";
+static constexpr size_t RECONCILE_BATCH_DEFAULT       = 10;
+
+// Admission control for dvdcli mount and unmount, see driver_scheduler.hpp.
+// driver_rate (operations per second), driver_burst and driver_concurrency
+// apply to every driver, driver_limits overrides them for named drivers:
+//   <driver>:rate=<r>,burst=<b>,concurrency=<c>[;<driver>:...]
+static constexpr char DRIVER_RATE_PARAM_NAME[]        = "driver_rate";
+static constexpr char DRIVER_BURST_PARAM_NAME[]       = "driver_burst";
+static constexpr char DRIVER_CONCURRENCY_PARAM_NAME[] = "driver_concurrency";
+static constexpr char DRIVER_LIMITS_PARAM_NAME[]      = "driver_limits";
+
+// Queued driver operations are admitted by priority: prepare() mounts,
+// then cleanup() unmounts, then background work. An operation gains one
+// priority class for every driver_priority_aging it spends queued.
+static constexpr char DRIVER_PRIORITY_AGING_PARAM_NAME[] =
+  "driver_priority_aging";
+static constexpr char DRIVER_PRIORITY_AGING_DEFAULT[] = "30secs";
+
+// Volumes mounted with cache=writethrough|writeback get a dm-cache on
+// logical volumes of cache_vg, a volume group on local SSD. Each cache
+// is cache_size, unless the volume asks for cachesize=<size>, and
+// cache_flush_timeout bounds how long unmounting waits for a writeback
+// cache to be written back.
+static constexpr char CACHE_VG_PARAM_NAME[]           = "cache_vg";
+static constexpr char CACHE_SIZE_PARAM_NAME[]         = "cache_size";
+static constexpr char CACHE_FLUSH_TIMEOUT_PARAM_NAME[] =
+  "cache_flush_timeout";
+static constexpr char CACHE_SIZE_DEFAULT[]            = "10GB";
+static constexpr char CACHE_FLUSH_TIMEOUT_DEFAULT[]   = "10mins";
+
+// Blank volumes are created ahead of time for the classes listed in
+// volume_pool (see VolumePool::parse), and topped up every
+// volume_pool_interval. A volume with pooled=true in its options is
+// taken from the pool of its driver, size and newfstype.
+static constexpr char VOLUME_POOL_PARAM_NAME[]        = "volume_pool";
+static constexpr char VOLUME_POOL_INTERVAL_PARAM_NAME[] =
+  "volume_pool_interval";
+static constexpr char VOLUME_POOL_INTERVAL_DEFAULT[]  = "1mins";
+
+// Directory shared by all agents, e.g. on NFS, where the pool records
+// which volume each pooled name was given, so that the name resolves
+// to the same volume on whichever agent the task runs. Required with
+// volume_pool.
+static constexpr char VOLUME_POOL_ALIAS_DIR_PARAM_NAME[] =
+  "volume_pool_alias_dir";
+
+// Container id recorded for the volumes the pool creates.
+static constexpr char POOL_CONTAINER_ID[]             = "dvdi-volume-pool";
+
+// Every flush_interval (0 disables it) volumes whose device has had more
+// than flush_threshold written since the last check are synced, so that
+// the unmount at cleanup() has little dirty data left to write back.
+static constexpr char FLUSH_INTERVAL_PARAM_NAME[]     = "flush_interval";
+static constexpr char FLUSH_THRESHOLD_PARAM_NAME[]    = "flush_threshold";
+static constexpr char FLUSH_INTERVAL_DEFAULT[]        = "30secs";
+static constexpr char FLUSH_THRESHOLD_DEFAULT[]       = "256MB";
+
+// With lease_dir set, the isolator holds a lease in a FileLeaseStore
+// there on each volume it has attached, renewed every third of
+// lease_ttl. prepare() fails fast on a volume another agent holds a
+// lease on, and takes over a volume whose lease has expired after force
+// detaching it with force_detach_cmd. lease_holder names this agent in
+// the store, and defaults to its hostname.
+static constexpr char LEASE_DIR_PARAM_NAME[]          = "lease_dir";
+static constexpr char LEASE_TTL_PARAM_NAME[]          = "lease_ttl";
+static constexpr char LEASE_HOLDER_PARAM_NAME[]       = "lease_holder";
+static constexpr char FORCE_DETACH_CMD_PARAM_NAME[]   = "force_detach_cmd";
+static constexpr char LEASE_TTL_DEFAULT[]             = "60secs";
+
+// native-lvm volumes are thin volumes in the lvm_thin_pool, given as
+// <vg>/<thin pool>. A volume with fromsnapshot=<snapshot> is created as
+// a clone of it on its first mount, and one with clonepolicy=destroy is
+// removed again after its last unmount, if that mount made the clone.
+static constexpr char LVM_THIN_POOL_PARAM_NAME[]      = "lvm_thin_pool";
+
+// Only thin volumes named with lvm_snapshot_prefix may be cloned, so
+// that a task can not clone the volume of another. The prefix may not
+// start with dvdi-, as the volumes of tasks do.
+static constexpr char LVM_SNAPSHOT_PREFIX_PARAM_NAME[] = "lvm_snapshot_prefix";
+static constexpr char LVM_SNAPSHOT_PREFIX_DEFAULT[]   = "snapshot-";
+
+// Comma separated host directories that native-bind volumes may bind,
+// or any directory under them. native-bind is disabled without it.
+static constexpr char NATIVE_BIND_ALLOWED_PARAM_NAME[] = "native_bind_allowed";
+
+// Threads running the unmounts handed off by cleanup() and recover(),
+// and the other driver work kept off libprocess threads.
+static constexpr size_t UNMOUNT_WORKERS               = 8;
+
+// Threads running the syncs of volumes about to be unmounted, and of
+// busy volumes. They are kept apart from the unmount workers, so that
+// long syncs never hold up unrelated unmounts.
+static constexpr size_t SYNC_WORKERS                  = 2;
+
+// The isolator's JSON endpoints are served under /dvdi/ on the agent.
+static constexpr char DVDI_ENDPOINTS_ID[]             = "dvdi";
+static constexpr char DRIVERS_ENDPOINT_NAME[]         = "drivers";
+static constexpr char POOL_ENDPOINT_NAME[]            = "pool";
+static constexpr char CONTAINERS_ENDPOINT_NAME[]      = "containers";
+
+// How prepare() made each volume of a container available: attached
+// by the driver, shared with a container that already had it mounted,
+// or taken back from a pending unmount without a detach.
+static constexpr char VOLUME_ATTACHED[]               = "attached";
+static constexpr char VOLUME_SHARED[]                 = "shared";
+static constexpr char VOLUME_RECLAIMED[]              = "reclaimed";
+
+// Timing environment variables set for the task, in milliseconds. The
+// volume ones take the same numeric suffix as the DVDI_VOLUME_NAME
+// they describe.
+static constexpr char PREPARE_MS_ENV_VAR_NAME[]       = "DVDI_PREPARE_MS";
+static constexpr char VOL_STATUS_ENV_VAR_NAME[]       = "DVDI_VOLUME_STATUS";
+static constexpr char VOL_QUEUE_WAIT_MS_ENV_VAR_NAME[] =
+  "DVDI_VOLUME_QUEUE_WAIT_MS";
+static constexpr char VOL_ATTACH_MS_ENV_VAR_NAME[]    = "DVDI_VOLUME_ATTACH_MS";
+
 
 class DockerVolumeDriverIsolator: public mesos::slave::Isolator
 {
 public:
   static Try<mesos::slave::Isolator*> create(const Parameters& parameters);
 
+  // As above, but every volume goes to driver, whatever its volume
+  // driver is, and need not have a volume plugin installed. Used to run
+  // the isolator against a fake driver in tests.
+  static Try<mesos::slave::Isolator*> create(
+    const Parameters& parameters,
+    const process::Owned<VolumeDriver>& driver);
+
   virtual ~DockerVolumeDriverIsolator();
 
   // Slave recovery is a feature of Mesos that allows task/executors
@@ -92,12 +246,26 @@ public:
   //     support a JSON array to allow multiple volume mounts per task.
   // 2. get desired volume driver (volumedriver=) from ENVIRONMENT from task in ExecutorInfo
   //     VOL_DRIVER_ENV_VAR_NAME is defined below
-  // 3. Check for other pre-existing users of the mount.
-  // 4. Only if we are first user, make dvdcli mount call <volumename>
+  //     The driver must be a known volume plugin, or one of the native
+  //     drivers, otherwise prepare fails.
+  //    A volume with pooled=true resolves to a pool volume, see VolumePool.
+  // 3. Check for other pre-existing users of the mount. A volume already
+  //    attached is recorded for the container at once, one that another
+  //    prepare() is attaching is waited for.
+  // 4. Only if we are first user, take the lease on the volume if leases
+  //    are enabled, then make dvdcli mount call <volumename>
   //    Mount location is fixed, based on volume name (/var/lib/rexray/volumes/
   //    this call is synchronous, and returns 0 if success
-  //    actual call is defined below in DVDCLI_MOUNT_CMD
-  // 5. Add entry to hashmap that contains root mountpath indexed by ContainerId
+  //    actual call is defined in DVDCLI_MOUNT_CMD
+  //    Volumes are grouped by driver, and a driver that supports it
+  //    gets one batch request per group.
+  //    A newly mounted volume gets the local cache requested with
+  //    cache= and the I/O profile requested with ioprofile= in its options.
+  //    The isolator lock is not held across these driver calls.
+  // 5. If a subpath was requested (<volumename>:<subpath>), create it
+  //    under the mount and bind mount it into the container sandbox.
+  //    The backing volume is attached once and shared by all subpaths.
+  // 6. Add entry to hashmap that contains root mountpath indexed by ContainerId
   virtual process::Future<Option<ContainerPrepareInfo>> prepare(
     const ContainerID& containerId,
     const ExecutorInfo& executorInfo,
@@ -124,21 +292,80 @@ public:
 
   // will (possibly) unmount here
   // 1. Get mount root path by looking up based on ContainerId
-  // 2. Start counting tasks using this same mount. Quit counted after count == 2
-  // 3. If count was exactly 1, Unmount the volume
-  //     dvdcli unmount defined in DVDCLI_UNMOUNT_CMD below
-  // 4. Remove the listing for this task's mount from hashmap
+  // 2. Check whether any other container still uses the same backing volume
+  //    (possibly through a different subpath)
+  // 3. Remove the listing for this task's mount from hashmap
+  // 4. If no other container uses the volume, start writing back its
+  //    dirty data with syncfs(), and hand the unmount to the
+  //    background workers, once per volume. The returned future is
+  //    satisfied when all the unmounts are done. Until an unmount has
+  //    started, a prepare() for the same volume takes it back instead.
+  //    Volumes of the same driver are unmounted in one batch if the
+  //    driver supports it. A volume's cache is flushed and removed first.
+  //     dvdcli unmount defined in DVDCLI_UNMOUNT_CMD
   virtual process::Future<Nothing> cleanup(
     const ContainerID& containerId);
 
 private:
-  DockerVolumeDriverIsolator(const Parameters& parameters);
+  DockerVolumeDriverIsolator(
+    const Parameters& parameters,
+    const process::Owned<VolumeDriver>& driver);
 
   const Parameters parameters;
 
+  // Installed volume plugins, consulted by prepare() so that a request
+  // for an unknown driver fails before any volume is attached.
+  process::Owned<VolumePluginRegistry> pluginRegistry;
+
+  // Rate and concurrency limits in front of the volume drivers.
+  process::Owned<DriverOperationScheduler> scheduler;
+
+  // The driver used for every volume plugin.
+  process::Owned<VolumeDriver> dvdcliDriver;
+
+  // The driver for the native-* volume drivers.
+  process::Owned<VolumeDriver> nativeDriver;
+
+  // The driver for native-lvm volumes.
+  process::Owned<ThinVolumeDriver> thinDriver;
+
+  // If set, the driver of every volume instead of the ones above.
+  process::Owned<VolumeDriver> driverOverride;
+
+  process::Owned<CacheTier> cacheTier;
+
+  // Set if lease_dir is.
+  process::Owned<LeaseStore> leaseStore;
+
+  // Set if volume_pool lists any classes.
+  process::Owned<VolumePool> volumePool;
+
+  process::Owned<HttpEndpoints> endpoints;
+
+  // Where the time to make a volume available went in prepare().
+  // Volumes attached in one batch share its queue wait and attach time.
+  struct VolumeTiming
+  {
+    std::string volumedriver;
+    std::string volumename;
+    std::string status = VOLUME_SHARED;
+
+    // Queued in the driver scheduler, or behind an unmount in progress.
+    Duration queueWait = Duration::zero();
+
+    // Attaching and mounting the volume, its cache and its profile.
+    Duration attach = Duration::zero();
+  };
+
+  struct ContainerTiming
+  {
+    Duration prepare;
+    std::vector<VolumeTiming> volumes;
+  };
+
   using ExternalMountID = size_t;
 
-  ExternalMountID getExternalMountId(ExternalMount& em) const {
+  ExternalMountID getExternalMountId(const ExternalMount& em) const {
     size_t seed = 0;
     std::string s1(boost::to_lower_copy(em.volumedriver()));
     std::string s2(boost::to_lower_copy(em.volumename()));
@@ -147,26 +374,242 @@ private:
     return seed;
   }
 
-  // Attempts to unmount specified external mount, returns true on success
-  bool unmount(
-    const ExternalMount& em,
-    const std::string&   callerLabelForLogging) const;
+  // Returns the driver that handles the named volume driver.
+  VolumeDriver* volumeDriver(const std::string& name) const;
+
+  // Splits mounts into groups that share a volume driver,
+  // keeping the order in which each driver first appears.
+  static std::vector<std::vector<ExternalMount>> groupByDriver(
+    const std::vector<ExternalMount>& mounts);
+
+  // Attempts to unmount the specified external mounts, which must all
+  // use the same driver. Returns true if all unmounts succeeded.
+  // A failed unmount is remembered in failedUnmounts, so that the
+  // reconciler can retry it.
+  // If given, proceed is called for each mount once the driver scheduler
+  // has admitted the unmount, and the mount is skipped if it returns false.
+  bool unmountVolumes(
+    const std::vector<ExternalMount>& mounts,
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority,
+    const std::function<bool(const ExternalMount&)>& proceed = nullptr);
+
+  // Attempts to mount the specified external mounts, which must all use
+  // the same driver. Returns the mounted volumes in the same order, with
+  // an empty mountpoint for each mount that failed. Stops at the first
+  // failure.
+  // If given, the queue wait and attach time of each mount are stored in
+  // mountTimings, in the same order.
+  std::vector<MountedVolume> mountVolumes(
+    const std::vector<ExternalMount>& mounts,
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority,
+    std::vector<VolumeTiming>* mountTimings = nullptr) const;
 
   // Attempts to mount specified external mount,
   // returns non-empty string on success
   std::string mount(
     const ExternalMount& em,
-    const std::string&   callerLabelForLogging) const;
+    const std::string&   callerLabelForLogging,
+    DriverOperationScheduler::Priority priority) const;
+
+  // Removes the volume of em, just unmounted by driver, if the isolator
+  // created it as a clone and its user asked for it to be destroyed once
+  // no longer in use.
+  void destroyClone(const ExternalMount& em, VolumeDriver* driver) const;
+
+  // Whether the volume of em is attached under a lease. Native volumes
+  // are local, or can be mounted on many hosts, and are not.
+  bool leased(const ExternalMount& em) const;
+
+  // Takes the lease on the volume of em before it is attached. If the
+  // lease of another agent has expired, the volume is force detached
+  // from that agent first.
+  Try<Nothing> acquireLease(const ExternalMount& em);
+
+  // Gives up the lease on the volume of em once it is detached.
+  void releaseLease(const ExternalMount& em);
+
+  // Renews the leases of every volume still attached, or being attached.
+  // Runs on the leaseRenewer.
+  void renewLeases();
+
+  // Queues a sync of the filesystems at mountpoints on the syncers, but
+  // for those with a sync queued already. Must be called with mutex held.
+  void syncInBackground(const std::vector<std::string>& mountpoints);
+
+  // Queues a sync of the volumes written more than flushThreshold since
+  // the last call. Runs on the flusher.
+  void flushVolumes();
+
+  // Hands the creation of volumes for the pool classes that are short to
+  // the workers, unless the last refill is still running. Runs on the
+  // poolRefiller.
+  void refillPool();
+
+  // Creates count volumes of poolClass at background priority, and adds
+  // them to the pool. Runs on the workers.
+  void createPoolVolumes(const PoolClass& poolClass, size_t count);
+
+  // Stacks the cache requested in the options of em, if any, over the
+  // volume just mounted at mountpoint. Returns None if none was requested.
+  Try<Option<VolumeCache>> attachCache(
+    const ExternalMount& em,
+    const std::string& mountpoint) const;
+
+  // Applies the I/O profile requested in the options of em, if any,
+  // to the volume just mounted at mountpoint.
+  void applyVolumeProfile(
+    const ExternalMount& em,
+    const std::string& mountpoint) const;
+
+  // Removes the records of containerId from infos, syncs the volumes no
+  // other container uses and queues their unmount. Returns the unmounts.
+  // Must be called with mutex held.
+  std::list<process::Future<Nothing>> releaseContainer(
+    const ContainerID& containerId,
+    const std::string& callerLabelForLogging,
+    DriverOperationScheduler::Priority priority);
+
+  // Queues an unmount of the mounts, which must all use the same driver,
+  // on the background workers, recording them in pendingUnmounts until
+  // done. Must be called with mutex held.
+  process::Future<Nothing> releaseInBackground(
+    const std::vector<ExternalMount>& mounts,
+    const std::string& callerLabelForLogging,
+    DriverOperationScheduler::Priority priority);
+
+  // Creates subpath under the volume mounted at mountpoint, and returns
+  // it with every symlink resolved, which is what is bind mounted. Fails
+  // if it resolves to anywhere outside of the volume.
+  Try<std::string> subPathSource(
+    const std::string& mountpoint,
+    const std::string& subpath) const;
+
+  // Unmounts each of the mounts, used to revert a partially completed
+  // prepare() so that a container gets all of its mounts or none.
+  void revertMounts(
+    const std::vector<process::Owned<ExternalMount>>& mounts,
+    const std::string& callerLabelForLogging);
+
+  // Writes all records in infos, and the pending unmounts and attaches,
+  // to the mount list checkpoint file. A pending unmount keeps the id of
+  // the container that last used it, and a pool volume being created
+  // has POOL_CONTAINER_ID, so recover() treats them as orphans.
+  void checkpointInfos() const;
+
+  // Compares the mount records against /proc/self/mountinfo, reports
+  // mounts that are missing from the kernel or that we failed to release,
+  // and (if reconcileRepair) repairs up to reconcileBatchSize of them.
+  // Runs on the reconciler's libprocess thread, and hands the repairs
+  // that need the driver to the workers.
+  void reconcile();
+
+  // Mounts again a volume in use that is missing from the mount table,
+  // and records where. Runs on the workers.
+  void remount(const ExternalMount& em);
 
   // Returns true if string contains at least one prohibited character
   // as defined in the list below.
   // This is intended as a tool to detect injection attack attempts.
   bool containsProhibitedChars(const std::string& s) const;
 
+  // As above for the DVDI_VOLUME_OPTS of a volume, which for the native
+  // drivers may also contain '/' and ':'.
+  bool containsProhibitedOptionChars(
+    const std::string& options,
+    const std::string& driver) const;
+
+  // Returns true if s is a relative path made of one or more components,
+  // none of which is empty, "." or "..", or contains a prohibited character.
+  bool isValidSubPath(const std::string& s) const;
+
+  // Guards the state below, which is shared by the isolator calls and
+  // the background tasks. It is never held while waiting for the driver
+  // scheduler, whose slots are held by workers that need it.
+  std::mutex mutex;
+
+  // Set once recover() has rebuilt infos, the reconciler does nothing
+  // before that.
+  bool recovered = false;
+
+  // Set while a pool refill is running on the workers.
+  bool poolRefilling = false;
+
+  // Volumes the reconciler has queued a remount of.
+  hashset<ExternalMountID> remounting;
+
   using containermountmap =
     multihashmap<ContainerID, process::Owned<ExternalMount>>;
   containermountmap infos;
 
+  // An unmount handed to the background workers by cleanup() or recover().
+  // Until it has started, prepare() may take the volume back instead.
+  struct PendingUnmount
+  {
+    // Moves on from QUEUED once, to STARTED when the worker gets to the
+    // unmount or to CANCELLED when prepare() takes the volume back. The
+    // worker reads it without mutex, as it holds a driver scheduler slot
+    // at the time.
+    enum State { QUEUED, STARTED, CANCELLED };
+
+    ExternalMount mount;
+    std::atomic<State> state{QUEUED};
+    process::Promise<Nothing> promise;
+  };
+
+  hashmap<ExternalMountID, process::Owned<PendingUnmount>> pendingUnmounts;
+
+  // A volume prepare() is attaching, or a pool volume being created.
+  // Driver calls are made without mutex, so another prepare() asking for
+  // the volume waits for this one to be done, and then looks for it in
+  // infos again.
+  struct PendingAttach
+  {
+    ExternalMount mount;
+
+    // Set by prepare() while it holds the lease on the volume, which
+    // the leaseRenewer then renews until the volume is in infos.
+    std::atomic<bool> leased{false};
+
+    process::Promise<Nothing> promise;
+  };
+
+  hashmap<ExternalMountID, process::Owned<PendingAttach>> pendingAttaches;
+
+  // Mounts whose unmount failed, indexed by mountpoint. It has a lock of
+  // its own as unmountVolumes() is called without mutex held. Always
+  // taken after mutex.
+  std::mutex failedUnmountsMutex;
+  hashmap<std::string, ExternalMount> failedUnmounts;
+
+  // The prepare() timings of each running container, served at
+  // /dvdi/containers. It has a lock of its own so the endpoint is not
+  // held up by a prepare() in progress. Always taken after mutex.
+  std::mutex timingsMutex;
+  hashmap<ContainerID, ContainerTiming> timings;
+
+  JSON::Object containerTimings();
+
+  process::Owned<WorkQueue> workers;
+
+  process::Owned<WorkQueue> syncers;
+
+  // Mountpoints with a sync queued or running on the syncers.
+  hashset<std::string> syncing;
+
+  process::Owned<PeriodicTask> reconciler;
+
+  process::Owned<PeriodicTask> poolRefiller;
+
+  process::Owned<PeriodicTask> flusher;
+
+  process::Owned<PeriodicTask> leaseRenewer;
+
+  // Bytes written to the device of each mountpoint at the last flush
+  // check. Only used by the flusher.
+  hashmap<std::string, Bytes> lastBytesWritten;
+
   // compiler had issues with the autodetecting size of following array,
   // thus a constant is defined
 
@@ -179,6 +622,28 @@ private:
 
   static std::string mountPbFilename;
   static std::string mesosWorkingDir;
+  static Duration reconcileInterval;
+  static bool reconcileRepair;
+  static size_t reconcileBatchSize;
+  static DriverLimits defaultDriverLimits;
+  static hashmap<std::string, DriverLimits> driverLimits;
+  static Duration driverPriorityAging;
+  static std::string cacheVolumeGroup;
+  static Bytes cacheSize;
+  static Duration cacheFlushTimeout;
+  static std::vector<PoolClass> poolClasses;
+  static Duration poolInterval;
+  static std::string poolAliasDir;
+  static std::string poolPbFilename;
+  static Duration flushInterval;
+  static Bytes flushThreshold;
+  static std::string leaseDir;
+  static Duration leaseTtl;
+  static std::string leaseHolder;
+  static std::string forceDetachCommand;
+  static std::string lvmThinPool;
+  static std::string lvmSnapshotPrefix;
+  static std::vector<std::string> nativeBindAllowed;
 };
 
 } /* namespace slave */
@@ -0,0 +1,329 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/strings.hpp>
+
+#include "driver_scheduler.hpp"
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace slave {
+
+static Duration toDuration(const std::chrono::steady_clock::duration& d)
+{
+  return Nanoseconds(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+static const char* priorityName(DriverOperationScheduler::Priority priority)
+{
+  switch (priority) {
+    case DriverOperationScheduler::PREPARE:    return "prepare";
+    case DriverOperationScheduler::CLEANUP:    return "cleanup";
+    case DriverOperationScheduler::BACKGROUND: return "background";
+  }
+
+  return "unknown";
+}
+
+DriverOperationScheduler::DriverOperationScheduler(
+    const DriverLimits& _defaultLimits,
+    const hashmap<string, DriverLimits>& _driverLimits,
+    const Duration& _agingInterval)
+  : defaultLimits(_defaultLimits),
+    driverLimits(_driverLimits),
+    agingInterval(_agingInterval) {}
+
+Try<hashmap<string, DriverLimits>> DriverOperationScheduler::parse(
+    const string& value,
+    const DriverLimits& defaults)
+{
+  hashmap<string, DriverLimits> result;
+
+  foreach (const string& entry, strings::tokenize(value, ";")) {
+    vector<string> driverAndLimits = strings::split(entry, ":");
+    if (driverAndLimits.size() != 2 ||
+        strings::trim(driverAndLimits[0]).empty()) {
+      return Error("Expecting <driver>:<limits> but found '" + entry + "'");
+    }
+
+    DriverLimits limits = defaults;
+
+    foreach (const string& limit,
+             strings::tokenize(driverAndLimits[1], ",")) {
+      vector<string> keyValue = strings::split(limit, "=");
+      if (keyValue.size() != 2) {
+        return Error("Expecting <key>=<value> but found '" + limit + "'");
+      }
+
+      const string key = strings::trim(keyValue[0]);
+
+      if (key == "concurrency") {
+        Try<size_t> concurrency = numify<size_t>(strings::trim(keyValue[1]));
+        if (concurrency.isError()) {
+          return Error("Invalid concurrency '" + keyValue[1] + "'");
+        }
+        limits.concurrency = concurrency.get();
+      } else if (key == "rate" || key == "burst") {
+        Try<double> number = numify<double>(strings::trim(keyValue[1]));
+        if (number.isError() || number.get() < 0) {
+          return Error("Invalid " + key + " '" + keyValue[1] + "'");
+        }
+
+        if (key == "rate") {
+          limits.rate = number.get();
+        } else {
+          limits.burst = number.get();
+        }
+      } else {
+        return Error("Unknown driver limit '" + key + "'");
+      }
+    }
+
+    if (limits.burst < 1) {
+      return Error("Burst for driver " + driverAndLimits[0] +
+                   " must be at least 1");
+    }
+
+    result[strings::trim(driverAndLimits[0])] = limits;
+  }
+
+  return result;
+}
+
+DriverOperationScheduler::DriverState& DriverOperationScheduler::state(
+    const string& driver)
+{
+  if (!drivers.contains(driver)) {
+    DriverState state;
+    state.limits = driverLimits.contains(driver)
+      ? driverLimits.at(driver)
+      : defaultLimits;
+
+    // Start with a full bucket.
+    state.tokens = state.limits.burst;
+    state.refilled = Clock::now();
+    drivers[driver] = state;
+  }
+
+  return drivers[driver];
+}
+
+void DriverOperationScheduler::refill(
+    DriverState& driver,
+    const Clock::time_point& now)
+{
+  if (driver.limits.rate <= 0) {
+    return;
+  }
+
+  const double elapsed =
+    std::chrono::duration<double>(now - driver.refilled).count();
+
+  driver.tokens = std::min(
+      driver.limits.burst,
+      driver.tokens + elapsed * driver.limits.rate);
+  driver.refilled = now;
+}
+
+uint64_t DriverOperationScheduler::next(
+    const DriverState& driver,
+    const Clock::time_point& now) const
+{
+  CHECK(!driver.queue.empty());
+
+  const double aging = agingInterval.secs();
+
+  uint64_t best = driver.queue.front().ticket;
+  double bestRank = 0;
+  bool first = true;
+
+  foreach (const Waiter& waiter, driver.queue) {
+    double rank = waiter.priority;
+
+    if (aging > 0) {
+      rank -= std::chrono::duration<double>(now - waiter.enqueued).count() /
+              aging;
+    }
+
+    // The queue is in arrival order, so strictly better is required
+    // to overtake an earlier operation.
+    if (first || rank < bestRank) {
+      best = waiter.ticket;
+      bestRank = rank;
+      first = false;
+    }
+  }
+
+  return best;
+}
+
+double DriverOperationScheduler::tokens(
+    const DriverLimits& limits,
+    size_t count)
+{
+  return std::min(static_cast<double>(count), limits.burst);
+}
+
+size_t DriverOperationScheduler::slots(
+    const DriverLimits& limits,
+    size_t count)
+{
+  return limits.concurrency == 0 ? count : std::min(count, limits.concurrency);
+}
+
+Duration DriverOperationScheduler::acquire(
+    const string& driver,
+    Priority priority,
+    size_t count)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  DriverState& d = state(driver);
+
+  const double needTokens = tokens(d.limits, count);
+  const size_t needSlots = slots(d.limits, count);
+
+  const Clock::time_point enqueued = Clock::now();
+  const uint64_t ticket = d.nextTicket++;
+  d.queue.push_back(Waiter{ticket, priority, enqueued});
+
+  bool queued = false;
+
+  while (true) {
+    const Clock::time_point now = Clock::now();
+    refill(d, now);
+
+    const bool first = next(d, now) == ticket;
+    const bool slot = d.limits.concurrency == 0 ||
+      d.inFlight + needSlots <= d.limits.concurrency;
+    const bool token = d.limits.rate <= 0 || d.tokens >= needTokens;
+
+    if (first && slot && token) {
+      break;
+    }
+
+    queued = true;
+
+    if (first && slot) {
+      // Only waiting for the bucket, sleep until enough tokens are due.
+      const std::chrono::duration<double> due(
+          (needTokens - d.tokens) / d.limits.rate);
+      changed.wait_for(
+          lock, std::chrono::duration_cast<Clock::duration>(due));
+    } else {
+      changed.wait(lock);
+    }
+  }
+
+  for (auto it = d.queue.begin(); it != d.queue.end(); ++it) {
+    if (it->ticket == ticket) {
+      d.queue.erase(it);
+      break;
+    }
+  }
+
+  d.inFlight += needSlots;
+  if (d.limits.rate > 0) {
+    d.tokens -= needTokens;
+  }
+
+  const Duration waited = toDuration(Clock::now() - enqueued);
+
+  d.admitted++;
+  d.totalWait += waited;
+  if (waited > d.maxWait) {
+    d.maxWait = waited;
+  }
+
+  if (queued) {
+    d.delayed++;
+    LOG(INFO) << "Volume driver " << driver << " " << priorityName(priority)
+              << " operation admitted after " << waited << ", "
+              << d.queue.size() << " still queued";
+  }
+
+  // The next operation in the queue may now be at the front.
+  changed.notify_all();
+
+  return waited;
+}
+
+void DriverOperationScheduler::release(const string& driver, size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  DriverState& d = state(driver);
+  const size_t releasedSlots = slots(d.limits, count);
+  CHECK_GE(d.inFlight, releasedSlots);
+  d.inFlight -= releasedSlots;
+
+  changed.notify_all();
+}
+
+JSON::Object DriverOperationScheduler::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  JSON::Object result;
+
+  foreachpair (const string& name, const DriverState& d, drivers) {
+    JSON::Object driver;
+    driver.values["queue_depth"] = JSON::Number(d.queue.size());
+
+    static const Priority priorities[] = {PREPARE, CLEANUP, BACKGROUND};
+
+    JSON::Object queued;
+    foreach (Priority priority, priorities) {
+      size_t count = 0;
+      foreach (const Waiter& waiter, d.queue) {
+        if (waiter.priority == priority) {
+          count++;
+        }
+      }
+      queued.values[priorityName(priority)] = JSON::Number(count);
+    }
+    driver.values["queued_by_priority"] = queued;
+
+    driver.values["in_flight"] = JSON::Number(d.inFlight);
+    driver.values["admitted"] = JSON::Number(d.admitted);
+    driver.values["delayed"] = JSON::Number(d.delayed);
+    driver.values["total_wait_secs"] = JSON::Number(d.totalWait.secs());
+    driver.values["max_wait_secs"] = JSON::Number(d.maxWait.secs());
+    driver.values["mean_wait_secs"] = JSON::Number(
+        d.admitted == 0 ? 0 : d.totalWait.secs() / d.admitted);
+
+    result.values[name] = driver;
+  }
+
+  return result;
+}
+
+} /* namespace slave */
+} /* namespace mesos */
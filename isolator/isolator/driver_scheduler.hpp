@@ -0,0 +1,168 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_DRIVER_SCHEDULER_HPP_
+#define SRC_DRIVER_SCHEDULER_HPP_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+
+#include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/json.hpp>
+#include <stout/try.hpp>
+
+namespace mesos {
+namespace slave {
+
+// Limits applied to the operations sent to one volume driver.
+// A rate of 0 or a concurrency of 0 means unlimited.
+struct DriverLimits
+{
+  // Operations admitted per second, on average.
+  double rate = 0;
+
+  // Operations that may be admitted back to back after a quiet period.
+  double burst = 1;
+
+  // Operations that may be in progress at once.
+  size_t concurrency = 0;
+};
+
+// Admission control in front of the volume driver operations
+// (dvdcli mount and unmount).
+//
+// Each driver gets a token bucket, refilled at DriverLimits::rate up to
+// DriverLimits::burst, and a limit on operations in flight. An operation
+// that finds no token or no free slot is queued (the calling thread
+// blocks in acquire()) rather than sent. Staying under the storage
+// provider's API throttle keeps a mass reschedule from turning into a
+// storm of throttled calls and retries.
+//
+// Queued operations are admitted by priority class, so that mounts for
+// tasks waiting to start go ahead of teardown, and teardown ahead of
+// background work. Every agingInterval an operation spends queued counts
+// as one class higher, so nothing starves. Within a class, operations
+// are admitted in arrival order.
+//
+// Queue depth and wait times are kept per driver and reported by stats().
+//
+// Thread safe.
+class DriverOperationScheduler
+{
+public:
+  enum Priority
+  {
+    // Mounts made by prepare() for a task waiting to start.
+    PREPARE = 0,
+    // Unmounts made by cleanup() once a task is gone.
+    CLEANUP = 1,
+    // Orphan reclamation after recover(), reconcile repairs.
+    BACKGROUND = 2
+  };
+
+  DriverOperationScheduler(
+      const DriverLimits& defaultLimits,
+      const hashmap<std::string, DriverLimits>& driverLimits,
+      const Duration& agingInterval);
+
+  // Parses per driver limits of the form
+  //   <driver>:rate=<r>,burst=<b>,concurrency=<c>[;<driver>:...]
+  // Keys that are not given keep the value from defaults.
+  static Try<hashmap<std::string, DriverLimits>> parse(
+      const std::string& value,
+      const DriverLimits& defaults);
+
+  // Blocks until an operation on driver may be sent, and returns how
+  // long the caller was queued. Every acquire() must be paired with
+  // a release() of the same count once the operation has completed.
+  //
+  // A batch of count volumes is admitted as a single operation, which
+  // takes count tokens and count in flight slots, each capped at the
+  // driver's limit so that a large batch can still be admitted. Only a
+  // driver that sends the whole batch as one request may be admitted
+  // this way, others are admitted one volume at a time.
+  Duration acquire(
+      const std::string& driver,
+      Priority priority,
+      size_t count = 1);
+
+  void release(const std::string& driver, size_t count = 1);
+
+  // Queue depth, operations in flight and wait times for each driver.
+  JSON::Object stats() const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Waiter
+  {
+    uint64_t ticket;
+    Priority priority;
+    Clock::time_point enqueued;
+  };
+
+  // The tokens and in flight slots taken by an operation on count volumes.
+  static double tokens(const DriverLimits& limits, size_t count);
+  static size_t slots(const DriverLimits& limits, size_t count);
+
+  struct DriverState
+  {
+    DriverLimits limits;
+
+    double tokens = 0;
+    Clock::time_point refilled;
+    size_t inFlight = 0;
+
+    // The queued operations, in arrival order.
+    uint64_t nextTicket = 0;
+    std::list<Waiter> queue;
+
+    uint64_t admitted = 0;
+    uint64_t delayed = 0;
+    Duration totalWait;
+    Duration maxWait;
+  };
+
+  DriverState& state(const std::string& driver);
+
+  // Adds the tokens earned since the last refill, up to the burst size.
+  static void refill(DriverState& driver, const Clock::time_point& now);
+
+  // Returns the ticket of the queued operation to admit next, the one
+  // with the best priority after aging, and the oldest among equals.
+  uint64_t next(const DriverState& driver, const Clock::time_point& now) const;
+
+  const DriverLimits defaultLimits;
+  const hashmap<std::string, DriverLimits> driverLimits;
+  const Duration agingInterval;
+
+  mutable std::mutex mutex;
+  std::condition_variable changed;
+  hashmap<std::string, DriverState> drivers;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_DRIVER_SCHEDULER_HPP_ */
@@ -0,0 +1,89 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_HTTP_ENDPOINTS_HPP_
+#define SRC_HTTP_ENDPOINTS_HPP_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/process.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/json.hpp>
+
+namespace mesos {
+namespace slave {
+
+// Serves read-only JSON endpoints on the agent's libprocess port, at
+// http://<agent>:<port>/<id>/<name>.
+//
+// Handlers run on this process's thread, not on the isolator's, so they
+// must do their own locking.
+class HttpEndpoints : public process::Process<HttpEndpoints>
+{
+public:
+  typedef std::function<JSON::Object()> Handler;
+
+  explicit HttpEndpoints(const std::string& id)
+    : ProcessBase(id) {}
+
+  virtual ~HttpEndpoints() {}
+
+  // Endpoints must be added before the process is spawned.
+  void add(
+      const std::string& name,
+      const std::string& help,
+      const Handler& handler)
+  {
+    endpoints.push_back(Endpoint{name, help, handler});
+  }
+
+protected:
+  virtual void initialize()
+  {
+    foreach (const Endpoint& endpoint, endpoints) {
+      const Handler handler = endpoint.handler;
+
+      route("/" + endpoint.name,
+            endpoint.help,
+            [handler](const process::http::Request& request)
+                -> process::Future<process::http::Response> {
+              return process::http::OK(handler());
+            });
+    }
+  }
+
+private:
+  struct Endpoint
+  {
+    std::string name;
+    std::string help;
+    Handler handler;
+  };
+
+  std::vector<Endpoint> endpoints;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_HTTP_ENDPOINTS_HPP_ */
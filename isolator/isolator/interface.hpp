@@ -2,10 +2,23 @@
 #define __INTERFACE_HPP__
 
 #include <isolator/interface.pb.h>
-using namespace emccode::isolator::mount;
 
 #include <stout/multihashmap.hpp>
 
+namespace mesos {
+namespace slave {
+
+// The checkpointed messages, by the names the isolator uses for them.
+using emccode::isolator::mount::ExternalMount;
+using emccode::isolator::mount::ExternalMountList;
+using emccode::isolator::mount::PooledVolume;
+using emccode::isolator::mount::VolumeAlias;
+using emccode::isolator::mount::VolumeCache;
+using emccode::isolator::mount::VolumePoolState;
+
+} /* namespace slave */
+} /* namespace mesos */
+
 class Builder
 {
 private:
@@ -16,6 +29,11 @@ private:
   std::string mountPoint;
   //hashmap<std::string, std::string> opts; //TODO revisit this later
   std::string options;
+  std::string subPath;
+  std::string accessMode;
+  emccode::isolator::mount::VolumeCache cache;
+  bool cached = false;
+  bool cloned = false;
 
 public:
   // create Builder with default values assigned
@@ -58,14 +76,48 @@ public:
     return *this;
   }
 
-  ExternalMount* build()
+  Builder& setSubPath( const std::string subPath )
+  {
+    this->subPath = subPath;
+    return *this;
+  }
+
+  Builder& setAccessMode( const std::string accessMode )
+  {
+    this->accessMode = accessMode;
+    return *this;
+  }
+
+  Builder& setCache( const emccode::isolator::mount::VolumeCache& cache )
   {
-    ExternalMount* mount = new ExternalMount();
+    this->cache = cache;
+    this->cached = true;
+    return *this;
+  }
+
+  Builder& setCloned( bool cloned )
+  {
+    this->cloned = cloned;
+    return *this;
+  }
+
+  emccode::isolator::mount::ExternalMount* build()
+  {
+    emccode::isolator::mount::ExternalMount* mount =
+      new emccode::isolator::mount::ExternalMount();
     mount->set_containerid(containerId);
     mount->set_volumedriver(volumeDriver);
     mount->set_volumename(volumeName);
     mount->set_mountpoint(mountPoint);
-    mount->set_options(mountPoint);
+    mount->set_options(options);
+    mount->set_subpath(subPath);
+    mount->set_accessmode(accessMode);
+    if (cached) {
+      mount->mutable_cache()->CopyFrom(cache);
+    }
+    if (cloned) {
+      mount->set_cloned(true);
+    }
 
     //TODO revisit this later
     /*
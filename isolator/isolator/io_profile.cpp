@@ -0,0 +1,216 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <sys/mount.h>
+#include <sys/sysmacros.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "linux/fs.hpp"
+
+#include "io_profile.hpp"
+#include "mount_utils.hpp"
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace slave {
+
+static const vector<IoProfile>& ioProfiles()
+{
+  static const vector<IoProfile> profiles = {
+    // Readahead only wastes bandwidth on random access, and a deep
+    // queue lets the device reorder the many small requests itself.
+    {"db-random", MS_NOATIME | MS_NODIRATIME, 16, 1024, {"none", "noop"}},
+
+    {"log-sequential", MS_NOATIME | MS_NODIRATIME, 1024, 256,
+     {"mq-deadline", "deadline"}},
+
+    {"bulk-read", MS_NOATIME | MS_NODIRATIME, 4096, 512,
+     {"mq-deadline", "deadline"}}
+  };
+
+  return profiles;
+}
+
+Option<IoProfile> findIoProfile(const string& name)
+{
+  foreach (const IoProfile& profile, ioProfiles()) {
+    if (profile.name == name) {
+      return profile;
+    }
+  }
+
+  return None();
+}
+
+// The per mount flags in the vfs options of a mount table entry that
+// a remount must keep.
+static unsigned long keptMountFlags(const string& vfsOptions)
+{
+  unsigned long flags = 0;
+
+  foreach (const string& option, strings::tokenize(vfsOptions, ",")) {
+    if (option == "ro") {
+      flags |= MS_RDONLY;
+    } else if (option == "nosuid") {
+      flags |= MS_NOSUID;
+    } else if (option == "nodev") {
+      flags |= MS_NODEV;
+    } else if (option == "noexec") {
+      flags |= MS_NOEXEC;
+    }
+  }
+
+  return flags;
+}
+
+// Returns the sysfs directory of the whole disk holding devno,
+// which is where the request queue settings live.
+static Try<string> blockDeviceDir(dev_t devno)
+{
+  const string device = path::join(
+      "/sys/dev/block",
+      stringify(major(devno)) + ":" + stringify(minor(devno)));
+
+  Result<string> realpath = os::realpath(device);
+  if (!realpath.isSome()) {
+    return Error("No block device found at " + device);
+  }
+
+  // A partition has no queue of its own, it uses its disk's.
+  if (os::exists(path::join(realpath.get(), "partition"))) {
+    return Path(realpath.get()).dirname();
+  }
+
+  return realpath.get();
+}
+
+static Try<Nothing> setScheduler(
+    const string& queueDir,
+    const vector<string>& preferred)
+{
+  const string file = path::join(queueDir, "scheduler");
+
+  Try<string> available = os::read(file);
+  if (available.isError()) {
+    return Error(available.error());
+  }
+
+  // The file lists the schedulers, the active one in brackets.
+  vector<string> schedulers;
+  foreach (const string& token, strings::tokenize(available.get(), " \n")) {
+    schedulers.push_back(strings::trim(token, "[]"));
+  }
+
+  foreach (const string& scheduler, preferred) {
+    if (std::find(schedulers.begin(), schedulers.end(), scheduler) !=
+        schedulers.end()) {
+      return os::write(file, scheduler);
+    }
+  }
+
+  return Error("none of " + strings::join(", ", preferred) +
+               " offered by " + file);
+}
+
+Try<Nothing> applyIoProfile(const IoProfile& profile, const string& mountpoint)
+{
+  const string target = strings::remove(mountpoint, "/", strings::SUFFIX);
+
+  Result<mesos::internal::fs::MountInfoTable::Entry> mount =
+    findMount(target);
+  if (mount.isError()) {
+    return Error(mount.error());
+  } else if (mount.isNone()) {
+    return Error(target + " is not mounted");
+  }
+
+  vector<string> errors;
+
+  // A bind remount changes the flags of this mount only, never the
+  // options of the filesystem, which may be mounted elsewhere too.
+  Try<Nothing> remount = mesos::internal::fs::mount(
+      None(),
+      target,
+      None(),
+      MS_REMOUNT | MS_BIND | keptMountFlags(mount.get().vfsOptions) |
+        profile.mountFlags,
+      NULL);
+  if (remount.isError()) {
+    errors.push_back("remount: " + remount.error());
+  }
+
+  // Network filesystems such as NFS have no block device.
+  if (major(mount.get().devno) == 0) {
+    LOG(INFO) << "I/O profile " << profile.name << " applied to " << target
+              << ", which has no block device to tune";
+  } else {
+    Try<string> deviceDir = blockDeviceDir(mount.get().devno);
+
+    if (deviceDir.isError()) {
+      errors.push_back(deviceDir.error());
+    } else {
+      const string queueDir = path::join(deviceDir.get(), "queue");
+
+      Try<Nothing> readAhead = os::write(
+          path::join(queueDir, "read_ahead_kb"),
+          stringify(profile.readAheadKb));
+      if (readAhead.isError()) {
+        errors.push_back("read_ahead_kb: " + readAhead.error());
+      }
+
+      Try<Nothing> nrRequests = os::write(
+          path::join(queueDir, "nr_requests"),
+          stringify(profile.nrRequests));
+      if (nrRequests.isError()) {
+        errors.push_back("nr_requests: " + nrRequests.error());
+      }
+
+      Try<Nothing> scheduler = setScheduler(queueDir, profile.schedulers);
+      if (scheduler.isError()) {
+        errors.push_back("scheduler: " + scheduler.error());
+      }
+
+      LOG(INFO) << "I/O profile " << profile.name << " applied to " << target
+                << " on device " << deviceDir.get();
+    }
+  }
+
+  if (!errors.empty()) {
+    return Error(strings::join("; ", errors));
+  }
+
+  return Nothing();
+}
+
+} /* namespace slave */
+} /* namespace mesos */
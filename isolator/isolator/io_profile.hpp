@@ -0,0 +1,68 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_IO_PROFILE_HPP_
+#define SRC_IO_PROFILE_HPP_
+
+#include <string>
+#include <vector>
+
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+namespace mesos {
+namespace slave {
+
+// Filesystem and block device settings for a kind of workload, chosen
+// per volume with ioprofile=<name> in DVDI_VOLUME_OPTS.
+//
+//   db-random       small random reads and writes, e.g. Cassandra
+//   log-sequential  append mostly logs, e.g. Kafka
+//   bulk-read       large sequential scans
+struct IoProfile
+{
+  std::string name;
+
+  // Per mount flags, set with a bind remount so that the filesystem's
+  // own options are left as the driver mounted them.
+  unsigned long mountFlags;
+
+  // Settings of the backing block device's request queue.
+  size_t readAheadKb;
+  size_t nrRequests;
+
+  // I/O schedulers in order of preference, the first one the device
+  // offers is used.
+  std::vector<std::string> schedulers;
+};
+
+Option<IoProfile> findIoProfile(const std::string& name);
+
+// Applies the profile to the filesystem mounted at mountpoint, and to
+// the block device behind it if there is one. Every setting is tried,
+// the error lists those that could not be applied.
+Try<Nothing> applyIoProfile(
+    const IoProfile& profile,
+    const std::string& mountpoint);
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_IO_PROFILE_HPP_ */
@@ -0,0 +1,203 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stout/error.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "lease_store.hpp"
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace slave {
+
+static constexpr char LEASE_FILE_SUFFIX[]         = ".lease";
+
+static double now()
+{
+  return std::chrono::duration<double>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool Lease::expired() const
+{
+  return expires <= now();
+}
+
+FileLeaseStore::FileLeaseStore(const string& _directory)
+  : directory(_directory) {}
+
+Try<Nothing> FileLeaseStore::transact(
+    const string& key,
+    const std::function<Try<Option<Lease>>(const Option<Lease>&)>& update)
+{
+  Try<Nothing> mkdir = os::mkdir(directory);
+  if (mkdir.isError()) {
+    return Error("Failed to create " + directory + ": " + mkdir.error());
+  }
+
+  string name = key;
+  std::replace_if(name.begin(), name.end(), [](char c) {
+    return !isalnum(c) && c != '.' && c != '_' && c != '-';
+  }, '_');
+
+  const string file = path::join(directory, name + LEASE_FILE_SUFFIX);
+
+  // A free lease is an empty file rather than no file, as removing a
+  // file another agent is waiting to lock would race.
+  int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return ErrnoError("Failed to open " + file);
+  }
+
+  if (::flock(fd, LOCK_EX) != 0) {
+    ErrnoError error("Failed to lock " + file);
+    ::close(fd);
+    return error;
+  }
+
+  string contents;
+  char buffer[256];
+  ssize_t length;
+  while ((length = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, length);
+  }
+
+  // <holder> <expires>
+  Option<Lease> current;
+  vector<string> fields = strings::tokenize(contents, " \n");
+  if (fields.size() == 2) {
+    Try<double> expires = numify<double>(fields[1]);
+    if (expires.isSome()) {
+      Lease lease;
+      lease.holder = fields[0];
+      lease.expires = expires.get();
+      current = lease;
+    }
+  }
+
+  Try<Option<Lease>> updated = update(current);
+
+  Try<Nothing> result = Nothing();
+  if (updated.isError()) {
+    result = Error(updated.error());
+  } else {
+    const string record = updated.get().isSome()
+      ? updated.get().get().holder + " " +
+        stringify(static_cast<uint64_t>(updated.get().get().expires)) + "\n"
+      : string();
+
+    if (::ftruncate(fd, 0) != 0 ||
+        ::pwrite(fd, record.data(), record.size(), 0) !=
+          static_cast<ssize_t>(record.size()) ||
+        ::fsync(fd) != 0) {
+      result = ErrnoError("Failed to write " + file);
+    }
+  }
+
+  ::flock(fd, LOCK_UN);
+  ::close(fd);
+
+  return result;
+}
+
+Try<Option<Lease>> FileLeaseStore::acquire(
+    const string& key,
+    const string& holder,
+    const Duration& ttl)
+{
+  Option<Lease> previous;
+
+  Try<Nothing> acquired = transact(
+      key,
+      [&](const Option<Lease>& current) -> Try<Option<Lease>> {
+    if (current.isSome() && current.get().holder != holder) {
+      if (!current.get().expired()) {
+        return Error(
+            "held by " + current.get().holder + " for another " +
+            stringify(Seconds(static_cast<int64_t>(
+                current.get().expires - now()))));
+      }
+
+      previous = current;
+    }
+
+    Lease lease;
+    lease.holder = holder;
+    lease.expires = now() + ttl.secs();
+    return Option<Lease>(lease);
+  });
+
+  if (acquired.isError()) {
+    return Error("Lease on " + key + " is " + acquired.error());
+  }
+
+  return previous;
+}
+
+Try<Nothing> FileLeaseStore::renew(
+    const string& key,
+    const string& holder,
+    const Duration& ttl)
+{
+  return transact(
+      key,
+      [&](const Option<Lease>& current) -> Try<Option<Lease>> {
+    if (current.isNone() || current.get().holder != holder) {
+      return Error("Lease on " + key + " was lost to " +
+                   (current.isSome() ? current.get().holder : "nobody"));
+    }
+
+    Lease lease = current.get();
+    lease.expires = now() + ttl.secs();
+    return Option<Lease>(lease);
+  });
+}
+
+Try<Nothing> FileLeaseStore::release(const string& key, const string& holder)
+{
+  return transact(
+      key,
+      [&](const Option<Lease>& current) -> Try<Option<Lease>> {
+    // Leave a lease taken over by another holder alone.
+    if (current.isSome() && current.get().holder != holder) {
+      return current;
+    }
+
+    return Option<Lease>::none();
+  });
+}
+
+} /* namespace slave */
+} /* namespace mesos */
@@ -0,0 +1,114 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_LEASE_STORE_HPP_
+#define SRC_LEASE_STORE_HPP_
+
+#include <functional>
+#include <string>
+
+#include <stout/duration.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+namespace mesos {
+namespace slave {
+
+struct Lease
+{
+  std::string holder;
+
+  // Wall clock time the lease runs out, in seconds since the epoch.
+  // Agents sharing a store must keep their clocks in sync.
+  double expires = 0;
+
+  bool expired() const;
+};
+
+// Leases on attached volumes, shared by every agent that may attach
+// them. An agent holds a lease for as long as it has the volume
+// attached, and renews it well within its ttl. A lease that was not
+// renewed in time belongs to an agent that is gone, and its volume may
+// be taken over.
+//
+// The operations map onto a compare-and-set on a key, as offered by
+// etcd transactions or ZooKeeper versioned writes.
+class LeaseStore
+{
+public:
+  virtual ~LeaseStore() {}
+
+  // Takes the lease on key for holder, if it is free, already held by
+  // holder, or expired. Returns the expired lease of another holder
+  // that was taken over, whose volume may still be attached there.
+  // Fails if another holder has a lease that has not expired.
+  virtual Try<Option<Lease>> acquire(
+      const std::string& key,
+      const std::string& holder,
+      const Duration& ttl) = 0;
+
+  // Extends holder's lease on key. Fails if holder has lost it.
+  virtual Try<Nothing> renew(
+      const std::string& key,
+      const std::string& holder,
+      const Duration& ttl) = 0;
+
+  // Gives up holder's lease on key, if holder still has it.
+  virtual Try<Nothing> release(
+      const std::string& key,
+      const std::string& holder) = 0;
+};
+
+// Keeps each lease in a file of its own under a directory, updated
+// under flock(2). The directory may be shared between agents over a
+// filesystem with working flock, such as NFSv4. Otherwise it is only
+// suitable for agents on one host, as in tests.
+class FileLeaseStore : public LeaseStore
+{
+public:
+  explicit FileLeaseStore(const std::string& directory);
+
+  virtual Try<Option<Lease>> acquire(
+      const std::string& key,
+      const std::string& holder,
+      const Duration& ttl);
+
+  virtual Try<Nothing> renew(
+      const std::string& key,
+      const std::string& holder,
+      const Duration& ttl);
+
+  virtual Try<Nothing> release(
+      const std::string& key,
+      const std::string& holder);
+
+private:
+  // Runs update on the current lease of key with its file locked, and
+  // stores the lease update returns, or frees the key for None.
+  Try<Nothing> transact(
+      const std::string& key,
+      const std::function<Try<Option<Lease>>(const Option<Lease>&)>& update);
+
+  const std::string directory;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_LEASE_STORE_HPP_ */
@@ -0,0 +1,130 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/sysmacros.h>
+
+#include <string>
+#include <vector>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "mount_utils.hpp"
+
+using std::string;
+using std::vector;
+
+namespace fs = mesos::internal::fs;
+
+namespace mesos {
+namespace slave {
+
+// Index of the sectors written field in /sys/dev/block/<dev>/stat.
+static constexpr size_t STAT_WRITE_SECTORS_INDEX  = 6;
+static constexpr uint64_t SECTOR_SIZE             = 512;
+
+Result<fs::MountInfoTable::Entry> findMount(const string& mountpoint)
+{
+  const string target = strings::remove(mountpoint, "/", strings::SUFFIX);
+
+  Try<fs::MountInfoTable> table = fs::MountInfoTable::read();
+  if (table.isError()) {
+    return Error("Failed to read the mount table: " + table.error());
+  }
+
+  // Later entries are mounted on top of earlier ones.
+  Option<fs::MountInfoTable::Entry> mount;
+  foreach (const fs::MountInfoTable::Entry& entry, table.get().entries) {
+    if (entry.target == target) {
+      mount = entry;
+    }
+  }
+
+  if (mount.isNone()) {
+    return None();
+  }
+
+  return mount.get();
+}
+
+Try<Nothing> syncFilesystem(const string& mountpoint)
+{
+  int fd = ::open(mountpoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return ErrnoError("Failed to open " + mountpoint);
+  }
+
+  if (::syncfs(fd) != 0) {
+    ErrnoError error("Failed to sync " + mountpoint);
+    ::close(fd);
+    return error;
+  }
+
+  ::close(fd);
+  return Nothing();
+}
+
+Try<Bytes> bytesWritten(const string& mountpoint)
+{
+  Result<fs::MountInfoTable::Entry> mount = findMount(mountpoint);
+  if (mount.isError()) {
+    return Error(mount.error());
+  } else if (mount.isNone()) {
+    return Error(mountpoint + " is not mounted");
+  }
+
+  const dev_t devno = mount.get().devno;
+  if (major(devno) == 0) {
+    return Error(mountpoint + " has no block device");
+  }
+
+  const string stat = path::join(
+      "/sys/dev/block",
+      stringify(major(devno)) + ":" + stringify(minor(devno)),
+      "stat");
+
+  Try<string> read = os::read(stat);
+  if (read.isError()) {
+    return Error("Failed to read " + stat + ": " + read.error());
+  }
+
+  vector<string> fields = strings::tokenize(read.get(), " \n");
+  if (fields.size() <= STAT_WRITE_SECTORS_INDEX) {
+    return Error("Unexpected contents of " + stat);
+  }
+
+  Try<uint64_t> sectors = numify<uint64_t>(fields[STAT_WRITE_SECTORS_INDEX]);
+  if (sectors.isError()) {
+    return Error("Unexpected contents of " + stat + ": " + sectors.error());
+  }
+
+  return Bytes(sectors.get() * SECTOR_SIZE);
+}
+
+} /* namespace slave */
+} /* namespace mesos */
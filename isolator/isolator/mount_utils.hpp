@@ -0,0 +1,52 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_MOUNT_UTILS_HPP_
+#define SRC_MOUNT_UTILS_HPP_
+
+#include <string>
+
+#include <stout/bytes.hpp>
+#include <stout/nothing.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
+
+#include "linux/fs.hpp"
+
+namespace mesos {
+namespace slave {
+
+// Returns the topmost mount at mountpoint, or None if nothing is
+// mounted there. A trailing separator on mountpoint is ignored.
+Result<mesos::internal::fs::MountInfoTable::Entry> findMount(
+    const std::string& mountpoint);
+
+// Writes back the dirty data of the filesystem mounted at mountpoint,
+// with syncfs(2).
+Try<Nothing> syncFilesystem(const std::string& mountpoint);
+
+// Returns how much has been written to the block device behind
+// mountpoint since it appeared, from its sysfs stat file. Fails for
+// filesystems without a block device, such as NFS.
+Try<Bytes> bytesWritten(const std::string& mountpoint);
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_MOUNT_UTILS_HPP_ */
@@ -0,0 +1,73 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PERIODIC_TASK_HPP_
+#define SRC_PERIODIC_TASK_HPP_
+
+#include <functional>
+#include <string>
+
+#include <process/delay.hpp>
+#include <process/id.hpp>
+#include <process/process.hpp>
+
+#include <stout/duration.hpp>
+
+namespace mesos {
+namespace slave {
+
+// Runs a task on a libprocess thread every interval, starting one
+// interval after the process is spawned. Used for isolator work that
+// must stay off the prepare()/cleanup() path.
+//
+// The task runs outside of the isolator's own call context, so it is
+// responsible for its own locking.
+class PeriodicTask : public process::Process<PeriodicTask>
+{
+public:
+  PeriodicTask(
+      const std::string& name,
+      const Duration& _interval,
+      const std::function<void()>& _task)
+    : ProcessBase(process::ID::generate(name)),
+      interval(_interval),
+      task(_task) {}
+
+  virtual ~PeriodicTask() {}
+
+protected:
+  virtual void initialize()
+  {
+    process::delay(interval, self(), &PeriodicTask::run);
+  }
+
+private:
+  void run()
+  {
+    task();
+    process::delay(interval, self(), &PeriodicTask::run);
+  }
+
+  const Duration interval;
+  const std::function<void()> task;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_PERIODIC_TASK_HPP_ */
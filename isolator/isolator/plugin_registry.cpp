@@ -0,0 +1,249 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <list>
+#include <string>
+
+#include <glog/logging.h>
+
+#include <stout/foreach.hpp>
+#include <stout/json.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/strings.hpp>
+
+#include "plugin_registry.hpp"
+
+using std::list;
+using std::string;
+
+namespace mesos {
+namespace slave {
+
+static bool isSocket(const string& path)
+{
+  struct stat s;
+  return ::stat(path.c_str(), &s) == 0 && S_ISSOCK(s.st_mode);
+}
+
+VolumePluginRegistry::VolumePluginRegistry()
+  : directories({PLUGIN_SOCKETS_DIR,
+                 PLUGIN_ETC_SPECS_DIR,
+                 PLUGIN_LIB_SPECS_DIR}),
+    inotifyFd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+  if (inotifyFd < 0) {
+    LOG(WARNING) << "Failed to initialize inotify for volume plugin "
+                 << "discovery, plugins will only be rediscovered when "
+                 << "an unknown driver is requested: "
+                 << strerror(errno);
+  }
+
+  scan();
+}
+
+VolumePluginRegistry::~VolumePluginRegistry()
+{
+  if (inotifyFd >= 0) {
+    ::close(inotifyFd);
+  }
+}
+
+Option<string> VolumePluginRegistry::lookup(const string& name)
+{
+  if (drainEvents()) {
+    LOG(INFO) << "Volume plugin directories changed, rescanning";
+    scan();
+  }
+
+  if (!plugins.contains(name)) {
+    // The plugin may live somewhere we are not watching, look again
+    // before reporting it as unknown.
+    scan();
+
+    if (!plugins.contains(name)) {
+      return None();
+    }
+  }
+
+  return plugins[name];
+}
+
+void VolumePluginRegistry::scan()
+{
+  plugins.clear();
+
+  // Scan in reverse precedence order so that earlier directories
+  // overwrite entries found in later ones.
+  for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+    if (!os::stat::isdir(*it)) {
+      continue;
+    }
+
+    if (inotifyFd >= 0) {
+      // Adding a watch for a directory that is already watched just
+      // returns the existing watch descriptor.
+      if (::inotify_add_watch(
+              inotifyFd,
+              it->c_str(),
+              IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+              IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF |
+              IN_ONLYDIR) < 0) {
+        LOG(WARNING) << "Failed to watch volume plugin directory " << *it
+                     << ": " << strerror(errno);
+      }
+    }
+
+    if (*it == PLUGIN_SOCKETS_DIR) {
+      scanSockets(*it);
+    } else {
+      scanSpecs(*it);
+    }
+  }
+
+  LOG(INFO) << "Discovered " << plugins.size() << " volume plugin(s)";
+}
+
+void VolumePluginRegistry::scanSockets(const string& directory)
+{
+  Try<list<string>> entries = os::ls(directory);
+  if (entries.isError()) {
+    LOG(WARNING) << "Failed to list volume plugin directory " << directory
+                 << ": " << entries.error();
+    return;
+  }
+
+  foreach (const string& entry, entries.get()) {
+    const string entryPath = path::join(directory, entry);
+
+    // A plugin socket is either <dir>/<name>.sock
+    // or <dir>/<name>/<name>.sock.
+    if (strings::endsWith(entry, PLUGIN_SOCKET_EXTENSION) &&
+        isSocket(entryPath)) {
+      const string name = strings::remove(
+          entry, PLUGIN_SOCKET_EXTENSION, strings::SUFFIX);
+      plugins[name] = PLUGIN_UNIX_URL_PREFIX + entryPath;
+    } else if (os::stat::isdir(entryPath)) {
+      const string socket =
+        path::join(entryPath, entry + PLUGIN_SOCKET_EXTENSION);
+
+      if (isSocket(socket)) {
+        plugins[entry] = PLUGIN_UNIX_URL_PREFIX + socket;
+      }
+    }
+  }
+}
+
+void VolumePluginRegistry::scanSpecs(const string& directory)
+{
+  Try<list<string>> entries = os::ls(directory);
+  if (entries.isError()) {
+    LOG(WARNING) << "Failed to list volume plugin directory " << directory
+                 << ": " << entries.error();
+    return;
+  }
+
+  foreach (const string& entry, entries.get()) {
+    const string entryPath = path::join(directory, entry);
+
+    if (strings::endsWith(entry, PLUGIN_SPEC_EXTENSION)) {
+      // A .spec file holds nothing but the plugin URL.
+      Try<string> read = os::read(entryPath);
+      if (read.isError() || strings::trim(read.get()).empty()) {
+        LOG(WARNING) << "Ignoring unreadable volume plugin spec "
+                     << entryPath;
+        continue;
+      }
+
+      const string name = strings::remove(
+          entry, PLUGIN_SPEC_EXTENSION, strings::SUFFIX);
+      plugins[name] = strings::trim(read.get());
+    } else if (strings::endsWith(entry, PLUGIN_JSON_EXTENSION)) {
+      // A .json spec holds the URL in its "Addr" member.
+      Try<string> read = os::read(entryPath);
+      if (read.isError()) {
+        LOG(WARNING) << "Ignoring unreadable volume plugin spec "
+                     << entryPath;
+        continue;
+      }
+
+      Try<JSON::Object> spec = JSON::parse<JSON::Object>(read.get());
+      if (spec.isError()) {
+        LOG(WARNING) << "Ignoring invalid volume plugin spec "
+                     << entryPath << ": " << spec.error();
+        continue;
+      }
+
+      Result<JSON::String> address = spec.get().find<JSON::String>("Addr");
+      if (!address.isSome()) {
+        LOG(WARNING) << "Ignoring volume plugin spec " << entryPath
+                     << " without an Addr";
+        continue;
+      }
+
+      const string name = strings::remove(
+          entry, PLUGIN_JSON_EXTENSION, strings::SUFFIX);
+      plugins[name] = address.get().value;
+    }
+  }
+}
+
+bool VolumePluginRegistry::drainEvents()
+{
+  if (inotifyFd < 0) {
+    return false;
+  }
+
+  // The events themselves are not inspected, any change to a plugin
+  // directory triggers a rescan of all of them.
+  bool changed = false;
+  char buffer[4096];
+
+  while (true) {
+    ssize_t length = ::read(inotifyFd, buffer, sizeof(buffer));
+
+    if (length > 0) {
+      changed = true;
+      continue;
+    }
+
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (length < 0 && errno != EAGAIN) {
+      LOG(WARNING) << "Failed to read volume plugin directory events: "
+                   << strerror(errno);
+      // Rescan to be safe, as we might have lost events.
+      changed = true;
+    }
+
+    break;
+  }
+
+  return changed;
+}
+
+} /* namespace slave */
+} /* namespace mesos */
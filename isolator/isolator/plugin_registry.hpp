@@ -0,0 +1,94 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PLUGIN_REGISTRY_HPP_
+#define SRC_PLUGIN_REGISTRY_HPP_
+
+#include <string>
+#include <vector>
+
+#include <stout/hashmap.hpp>
+#include <stout/option.hpp>
+
+namespace mesos {
+namespace slave {
+
+// Locations searched for docker volume plugins, in the same order
+// docker (and dvdcli) search them. A socket found in the first
+// directory wins over a spec file of the same name in the others.
+static constexpr char PLUGIN_SOCKETS_DIR[]        = "/run/docker/plugins";
+static constexpr char PLUGIN_ETC_SPECS_DIR[]      = "/etc/docker/plugins";
+static constexpr char PLUGIN_LIB_SPECS_DIR[]      = "/usr/lib/docker/plugins";
+
+static constexpr char PLUGIN_SOCKET_EXTENSION[]   = ".sock";
+static constexpr char PLUGIN_SPEC_EXTENSION[]     = ".spec";
+static constexpr char PLUGIN_JSON_EXTENSION[]     = ".json";
+static constexpr char PLUGIN_UNIX_URL_PREFIX[]    = "unix://";
+
+// In-memory registry of docker volume plugins, mapping each plugin name
+// to its endpoint (a unix:// socket URL or the URL from its spec file).
+//
+// The registry is built once by scanning the plugin directories, and
+// kept current by an inotify watch on each of them. Pending inotify
+// events are drained (without blocking) on every lookup, and any event
+// causes a rescan, so a lookup that hits the registry costs one read(2)
+// rather than a walk of all plugin directories.
+//
+// A lookup that misses forces one rescan before reporting the plugin
+// as unknown. This covers plugin directories that did not exist when
+// the registry was built and sockets created in plugin subdirectories,
+// neither of which are watched.
+//
+// Not thread safe, used only from prepare().
+class VolumePluginRegistry
+{
+public:
+  VolumePluginRegistry();
+  ~VolumePluginRegistry();
+
+  // Returns the endpoint of the named plugin, or None if no plugin
+  // of that name is installed.
+  Option<std::string> lookup(const std::string& name);
+
+private:
+  VolumePluginRegistry(const VolumePluginRegistry&) = delete;
+  VolumePluginRegistry& operator=(const VolumePluginRegistry&) = delete;
+
+  // Rebuilds plugins from the plugin directories, and adds an inotify
+  // watch for any of them that now exists.
+  void scan();
+
+  // Reads all queued inotify events, returns true if there were any.
+  bool drainEvents();
+
+  void scanSockets(const std::string& directory);
+  void scanSpecs(const std::string& directory);
+
+  const std::vector<std::string> directories;
+
+  // -1 if inotify is unavailable, in which case the registry is
+  // refreshed only by lookups that miss.
+  int inotifyFd;
+
+  hashmap<std::string, std::string> plugins;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_PLUGIN_REGISTRY_HPP_ */
@@ -0,0 +1,291 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include <glog/logging.h>
+
+#include <stout/bytes.hpp>
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "linux/fs.hpp"
+
+#include "mount_utils.hpp"
+#include "thin_volume_driver.hpp"
+
+using std::string;
+
+namespace fs = mesos::internal::fs;
+
+namespace mesos {
+namespace slave {
+
+static constexpr char THIN_SIZE_OPTION[]          = "size";
+static constexpr char THIN_FSTYPE_OPTION[]        = "newfstype";
+static constexpr char THIN_FSTYPE_DEFAULT[]       = "ext4";
+
+static Try<string> run(const string& command)
+{
+  LOG(INFO) << "Invoking " << command;
+
+  Try<string> output = os::shell("%s 2>&1", command.c_str());
+  if (output.isError()) {
+    return Error("'" + command + "' failed: " + output.error());
+  }
+
+  return output.get();
+}
+
+static bool isLvmName(const string& name)
+{
+  return !name.empty() &&
+         std::all_of(name.begin(), name.end(), [](char c) {
+           return isalnum(c) || c == '.' || c == '_' || c == '-' || c == '+';
+         });
+}
+
+ThinVolumeDriver::ThinVolumeDriver(
+    const string& _thinPool,
+    const string& _snapshotPrefix)
+  : snapshotPrefix(_snapshotPrefix)
+{
+  const size_t separator = _thinPool.find('/');
+  if (separator != string::npos) {
+    volumeGroup = _thinPool.substr(0, separator);
+    thinPool = _thinPool;
+  }
+}
+
+bool ThinVolumeDriver::snapshotAllowed(const string& snapshot) const
+{
+  return isLvmName(snapshot) &&
+         !snapshotPrefix.empty() &&
+         snapshot.size() > snapshotPrefix.size() &&
+         strings::startsWith(snapshot, snapshotPrefix) &&
+         !strings::startsWith(snapshot, THIN_VOLUME_PREFIX);
+}
+
+string ThinVolumeDriver::logicalVolumeName(const ExternalMount& em)
+{
+  string name = em.volumename();
+  std::replace_if(name.begin(), name.end(), [](char c) {
+    return !isalnum(c) && c != '.' && c != '_' && c != '-' && c != '+';
+  }, '_');
+
+  return THIN_VOLUME_PREFIX + name;
+}
+
+string ThinVolumeDriver::logicalVolume(const ExternalMount& em) const
+{
+  return volumeGroup + "/" + logicalVolumeName(em);
+}
+
+Try<Nothing> ThinVolumeDriver::create(const ExternalMount& em) const
+{
+  const string lv = logicalVolume(em);
+  const string name = logicalVolumeName(em);
+
+  Option<string> snapshot;
+  Option<string> size;
+  string fstype = THIN_FSTYPE_DEFAULT;
+
+  foreach (const auto& option, parseDriverOptions(em.options())) {
+    if (option.first == FROM_SNAPSHOT_OPTION) {
+      snapshot = option.second;
+    } else if (option.first == THIN_SIZE_OPTION) {
+      size = option.second;
+    } else if (option.first == THIN_FSTYPE_OPTION) {
+      fstype = option.second;
+    } else {
+      return Error("Option " + option.first + " is not supported by " +
+                   em.volumedriver());
+    }
+  }
+
+  if (snapshot.isSome()) {
+    // Any other thin volume in the group may be the live volume of
+    // another task.
+    if (!snapshotAllowed(snapshot.get())) {
+      return Error("Snapshot '" + snapshot.get() + "' is not allowed, "
+                   "snapshot names must start with '" + snapshotPrefix + "'");
+    }
+
+    // A thin snapshot needs no size, and -kn keeps it from being
+    // skipped on activation like other snapshots.
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    Try<string> cloned = run(
+        "lvcreate -y -s -kn -n " + name + " " +
+        volumeGroup + "/" + snapshot.get());
+    if (cloned.isError()) {
+      return Error(cloned.error());
+    }
+
+    LOG(INFO) << "Cloned " << lv << " from " << snapshot.get() << " in "
+              << stopwatch.elapsed();
+
+    return Nothing();
+  }
+
+  if (size.isNone()) {
+    return Error(em.volumedriver() + " requires a " + THIN_SIZE_OPTION +
+                 " or " + FROM_SNAPSHOT_OPTION + " option to create " +
+                 em.volumename());
+  }
+
+  // A bare number is in GB, as for rexray.
+  Try<uint64_t> gigabytes = numify<uint64_t>(size.get());
+  Try<Bytes> bytes = gigabytes.isSome()
+    ? Try<Bytes>(Gigabytes(gigabytes.get()))
+    : Bytes::parse(size.get());
+
+  if (bytes.isError() || bytes.get() == Bytes(0)) {
+    return Error("Invalid " + string(THIN_SIZE_OPTION) + " '" +
+                 size.get() + "'");
+  }
+
+  if (!isLvmName(fstype)) {
+    return Error("Invalid " + string(THIN_FSTYPE_OPTION) + " '" +
+                 fstype + "'");
+  }
+
+  Try<string> created = run(
+      "lvcreate -y -T " + thinPool + " -V " +
+      stringify(bytes.get().bytes()) + "b -n " + name);
+  if (created.isError()) {
+    return Error(created.error());
+  }
+
+  Try<string> formatted = run("mkfs -t " + fstype + " /dev/" + lv);
+  if (formatted.isError()) {
+    run("lvremove -y " + lv);
+    return Error(formatted.error());
+  }
+
+  return Nothing();
+}
+
+Try<MountedVolume> ThinVolumeDriver::mount(const ExternalMount& em)
+{
+  if (!enabled()) {
+    return Error("No LVM thin pool is configured for " + em.volumedriver());
+  }
+
+  const string target =
+    path::join(NATIVE_MOUNT_PREFIX, em.volumedriver(), em.volumename());
+
+  Result<fs::MountInfoTable::Entry> existing = findMount(target);
+  if (existing.isError()) {
+    return Error(existing.error());
+  } else if (existing.isSome()) {
+    LOG(INFO) << em.volumename() << " is already mounted at " << target;
+    return MountedVolume(target);
+  }
+
+  const string lv = logicalVolume(em);
+  const string device = "/dev/" + lv;
+
+  const bool clone =
+    findVolumeOption(em.options(), FROM_SNAPSHOT_OPTION).isSome();
+  bool cloned = false;
+
+  if (run("lvs --noheadings -o lv_name " + lv).isError()) {
+    Try<Nothing> created = create(em);
+    if (created.isError()) {
+      return Error("Failed to create " + lv + ": " + created.error());
+    }
+    cloned = clone;
+  } else if (clone) {
+    LOG(INFO) << lv << " already exists and is used as it is, rather "
+              << "than cloned";
+  }
+
+  // Volumes are left active, but may not be after a reboot.
+  Try<string> activated = run("lvchange -ay " + lv);
+  if (activated.isError()) {
+    return Error(activated.error());
+  }
+
+  Try<string> fstype = run("blkid -o value -s TYPE " + device);
+  if (fstype.isError()) {
+    return Error(fstype.error());
+  }
+
+  Try<Nothing> mkdir = os::mkdir(target);
+  if (mkdir.isError()) {
+    return Error("Failed to create mountpoint " + target + ": " +
+                 mkdir.error());
+  }
+
+  LOG(INFO) << "Mounting " << device << " at " << target;
+
+  Try<Nothing> mounted =
+    fs::mount(device, target, strings::trim(fstype.get()), 0, NULL);
+  if (mounted.isError()) {
+    os::rmdir(target, false);
+    return Error("Failed to mount " + device + " at " + target + ": " +
+                 mounted.error());
+  }
+
+  return MountedVolume(target, cloned);
+}
+
+Try<Nothing> ThinVolumeDriver::unmount(const ExternalMount& em)
+{
+  const string target = em.mountpoint().empty()
+    ? path::join(NATIVE_MOUNT_PREFIX, em.volumedriver(), em.volumename())
+    : em.mountpoint();
+
+  LOG(INFO) << "Unmounting " << target;
+
+  Try<Nothing> unmounted = fs::unmount(target);
+  if (unmounted.isError()) {
+    return Error("Failed to unmount " + target + ": " + unmounted.error());
+  }
+
+  os::rmdir(target, false);
+
+  return Nothing();
+}
+
+Try<Nothing> ThinVolumeDriver::remove(const ExternalMount& em)
+{
+  if (!enabled()) {
+    return VolumeDriver::remove(em);
+  }
+
+  Try<string> removed = run("lvremove -y " + logicalVolume(em));
+  if (removed.isError()) {
+    return Error(removed.error());
+  }
+
+  return Nothing();
+}
+
+} /* namespace slave */
+} /* namespace mesos */
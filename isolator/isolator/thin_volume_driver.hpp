@@ -0,0 +1,85 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_THIN_VOLUME_DRIVER_HPP_
+#define SRC_THIN_VOLUME_DRIVER_HPP_
+
+#include <string>
+
+#include <stout/nothing.hpp>
+#include <stout/try.hpp>
+
+#include "interface.hpp"
+#include "volume_driver.hpp"
+
+namespace mesos {
+namespace slave {
+
+// The logical volumes of native-lvm volumes are named dvdi-<name>.
+static constexpr char THIN_VOLUME_PREFIX[]        = "dvdi-";
+
+// Serves native-lvm volumes as thin logical volumes in an LVM thin
+// pool on the agent, mounted at NATIVE_MOUNT_PREFIX native-lvm/<name>.
+//
+// A volume is created on its first mount, either blank, with the size
+// and newfstype options (size in GB, as for rexray, or with a unit), or
+// with fromsnapshot=<lv> as a thin snapshot of another thin volume in
+// the same volume group. Only volumes named with the snapshot prefix
+// may be cloned, never the dvdi-<name> volume of a task. A thin
+// snapshot shares every block with its origin until written, so even a
+// large golden image is cloned in well under a second. A volume that
+// exists already is used as it is, and is not reported as a clone. The
+// volume is kept when unmounted, until removed.
+class ThinVolumeDriver : public VolumeDriver
+{
+public:
+  // thinPool is <volume group>/<thin pool>. An empty one disables the
+  // driver.
+  ThinVolumeDriver(
+      const std::string& thinPool,
+      const std::string& snapshotPrefix);
+
+  bool enabled() const { return !volumeGroup.empty(); }
+
+  // Whether the thin volume named snapshot may be cloned.
+  bool snapshotAllowed(const std::string& snapshot) const;
+
+  virtual Try<MountedVolume> mount(const ExternalMount& em);
+
+  virtual Try<Nothing> unmount(const ExternalMount& em);
+
+  virtual Try<Nothing> remove(const ExternalMount& em);
+
+private:
+  static std::string logicalVolumeName(const ExternalMount& em);
+
+  // <volume group>/<logical volume> of the volume.
+  std::string logicalVolume(const ExternalMount& em) const;
+
+  // Creates the logical volume of em, blank and formatted, or cloned.
+  Try<Nothing> create(const ExternalMount& em) const;
+
+  std::string volumeGroup;
+  std::string thinPool;
+  const std::string snapshotPrefix;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_THIN_VOLUME_DRIVER_HPP_ */
@@ -0,0 +1,445 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <netdb.h>
+#include <sys/mount.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/strings.hpp>
+
+#include "linux/fs.hpp"
+
+#include "mount_utils.hpp"
+#include "volume_driver.hpp"
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace slave {
+
+VolumeOptions parseVolumeOptions(const string& options)
+{
+  VolumeOptions result;
+
+  foreach (const string& option,
+           strings::tokenize(options, VOL_OPTS_SEPARATOR)) {
+    const size_t separator = option.find(VOL_OPT_KEY_SEPARATOR);
+
+    if (separator == string::npos) {
+      result.push_back(std::make_pair(strings::trim(option), string()));
+    } else {
+      result.push_back(std::make_pair(
+          strings::trim(option.substr(0, separator)),
+          strings::trim(option.substr(separator + 1))));
+    }
+  }
+
+  return result;
+}
+
+static bool isIsolatorOption(const string& key)
+{
+  static const char* const options[] = {
+    IO_PROFILE_OPTION,
+    CACHE_OPTION,
+    CACHE_SIZE_OPTION,
+    POOLED_OPTION,
+    CLONE_POLICY_OPTION,
+    ACCESS_MODE_OPTION
+  };
+
+  foreach (const char* option, options) {
+    if (key == option) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+VolumeOptions parseDriverOptions(const string& options)
+{
+  VolumeOptions result;
+
+  foreach (const auto& option, parseVolumeOptions(options)) {
+    if (!isIsolatorOption(option.first)) {
+      result.push_back(option);
+    }
+  }
+
+  return result;
+}
+
+Option<string> findVolumeOption(const string& options, const string& key)
+{
+  foreach (const auto& option, parseVolumeOptions(options)) {
+    if (option.first == key) {
+      return option.second;
+    }
+  }
+
+  return None();
+}
+
+vector<Try<MountedVolume>> VolumeDriver::mountBatch(
+    const vector<ExternalMount>& mounts)
+{
+  vector<Try<MountedVolume>> results;
+  foreach (const ExternalMount& em, mounts) {
+    results.push_back(mount(em));
+  }
+  return results;
+}
+
+vector<Try<Nothing>> VolumeDriver::unmountBatch(
+    const vector<ExternalMount>& mounts)
+{
+  vector<Try<Nothing>> results;
+  foreach (const ExternalMount& em, mounts) {
+    results.push_back(unmount(em));
+  }
+  return results;
+}
+
+string DvdcliVolumeDriver::mountCommand(const ExternalMount& em)
+{
+  std::stringstream command;
+  command << DVDCLI_MOUNT_CMD << " "
+          << VOL_DRIVER_CMD_OPTION << em.volumedriver() << " "
+          << VOL_NAME_CMD_OPTION << em.volumename();
+
+  // dvdcli takes each option as a separate --volumeopts=key=value.
+  foreach (const auto& option, parseDriverOptions(em.options())) {
+    command << " " << VOL_OPTS_CMD_OPTION << option.first;
+    if (!option.second.empty()) {
+      command << VOL_OPT_KEY_SEPARATOR << option.second;
+    }
+  }
+
+  return command.str();
+}
+
+string DvdcliVolumeDriver::unmountCommand(const ExternalMount& em)
+{
+  std::stringstream command;
+  command << DVDCLI_UNMOUNT_CMD << " "
+          << VOL_DRIVER_CMD_OPTION << em.volumedriver() << " "
+          << VOL_NAME_CMD_OPTION << em.volumename();
+
+  return command.str();
+}
+
+Try<MountedVolume> DvdcliVolumeDriver::mount(const ExternalMount& em)
+{
+  if (!system(NULL)) { // Is a command processor available?
+    return Error("Failed to acquire a command processor for mount");
+  }
+
+  const string command = mountCommand(em);
+  LOG(INFO) << "Invoking " << command;
+
+  Try<string> retcode = os::shell("%s", command.c_str());
+  if (retcode.isError()) {
+    return Error(string(DVDCLI_MOUNT_CMD) + " failed: " + retcode.error());
+  }
+
+  return MountedVolume(retcode.get());
+}
+
+Try<Nothing> DvdcliVolumeDriver::unmount(const ExternalMount& em)
+{
+  if (!system(NULL)) { // Is a command processor available?
+    return Error("Failed to acquire a command processor for unmount");
+  }
+
+  const string command = unmountCommand(em);
+  LOG(INFO) << "Invoking " << command;
+
+  Try<string> retcode = os::shell("%s", command.c_str());
+  if (retcode.isError()) {
+    return Error(string(DVDCLI_UNMOUNT_CMD) + " failed: " + retcode.error());
+  }
+
+  LOG(INFO) << DVDCLI_UNMOUNT_CMD << " returned " << retcode.get();
+  return Nothing();
+}
+
+Try<Nothing> DvdcliVolumeDriver::forceDetach(const ExternalMount& em)
+{
+  if (forceDetachCommand.empty()) {
+    return VolumeDriver::forceDetach(em);
+  }
+
+  return runVolumeCommand(forceDetachCommand, em);
+}
+
+Try<Nothing> DvdcliVolumeDriver::runVolumeCommand(
+    const string& volumeCommand,
+    const ExternalMount& em)
+{
+  const string command = strings::replace(
+      strings::replace(volumeCommand,
+                       COMMAND_DRIVER_PLACEHOLDER,
+                       em.volumedriver()),
+      COMMAND_VOLUME_PLACEHOLDER,
+      em.volumename());
+
+  LOG(INFO) << "Invoking " << command;
+
+  Try<string> retcode = os::shell("%s", command.c_str());
+  if (retcode.isError()) {
+    return Error("'" + command + "' failed: " + retcode.error());
+  }
+
+  return Nothing();
+}
+
+// mount(2) flags that may be given in DVDI_VOLUME_OPTS.
+static const std::map<string, unsigned long>& nativeMountFlags()
+{
+  static const std::map<string, unsigned long> flags = {
+    {"ro", MS_RDONLY},
+    {"nosuid", MS_NOSUID},
+    {"nodev", MS_NODEV},
+    {"noexec", MS_NOEXEC},
+    {"noatime", MS_NOATIME},
+    {"nodiratime", MS_NODIRATIME},
+    {"relatime", MS_RELATIME}
+  };
+
+  return flags;
+}
+
+// The kernel NFS client does not resolve host names itself,
+// it wants the server address in the addr= option.
+static Try<string> resolveNfsServer(const string& host)
+{
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* result = NULL;
+  int error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+  if (error != 0) {
+    return Error("Failed to resolve NFS server " + host + ": " +
+                 gai_strerror(error));
+  }
+
+  char address[INET6_ADDRSTRLEN] = {};
+  const void* in = result->ai_family == AF_INET6
+    ? static_cast<const void*>(
+        &reinterpret_cast<sockaddr_in6*>(result->ai_addr)->sin6_addr)
+    : static_cast<const void*>(
+        &reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr);
+  const bool converted =
+    inet_ntop(result->ai_family, in, address, sizeof(address)) != NULL;
+
+  freeaddrinfo(result);
+
+  if (!converted) {
+    return ErrnoError("Failed to format the address of NFS server " + host);
+  }
+
+  return string(address);
+}
+
+bool NativeVolumeDriver::handles(const string& name)
+{
+  return name == NATIVE_NFS_DRIVER ||
+         name == NATIVE_BIND_DRIVER ||
+         name == NATIVE_TMPFS_DRIVER ||
+         name == NATIVE_LVM_DRIVER;
+}
+
+string NativeVolumeDriver::mountPoint(const ExternalMount& em)
+{
+  return path::join(NATIVE_MOUNT_PREFIX, em.volumedriver(), em.volumename());
+}
+
+Try<string> NativeVolumeDriver::bindSource(const string& source) const
+{
+  if (bindAllowed.empty()) {
+    return Error(string(NATIVE_BIND_DRIVER) +
+                 " is disabled, no host directories are allowed");
+  }
+
+  // Resolved first, so that no symlink leads out of an allowed directory.
+  Result<string> resolved = os::realpath(source);
+  if (!strings::startsWith(source, "/") || !resolved.isSome() ||
+      !os::stat::isdir(resolved.get())) {
+    return Error(string(NATIVE_BIND_DRIVER) + " requires a " +
+                 NATIVE_SOURCE_OPTION +
+                 "=<directory> option naming an existing host directory");
+  }
+
+  foreach (const string& allowed, bindAllowed) {
+    Result<string> root = os::realpath(allowed);
+    if (!root.isSome()) {
+      continue;
+    }
+
+    if (resolved.get() == root.get() || root.get() == "/" ||
+        strings::startsWith(resolved.get(), root.get() + "/")) {
+      return resolved.get();
+    }
+  }
+
+  return Error("Host directory " + source + " is not under any directory " +
+               NATIVE_BIND_DRIVER + " is allowed to bind");
+}
+
+Try<MountedVolume> NativeVolumeDriver::mount(const ExternalMount& em)
+{
+  const string& driver = em.volumedriver();
+  const string target = mountPoint(em);
+
+  string source;
+  unsigned long flags = 0;
+  std::vector<string> data;
+
+  foreach (const auto& option, parseDriverOptions(em.options())) {
+    if (option.first == NATIVE_SOURCE_OPTION) {
+      source = option.second;
+    } else if (nativeMountFlags().count(option.first) > 0 &&
+               option.second.empty()) {
+      flags |= nativeMountFlags().at(option.first);
+    } else if (driver == NATIVE_BIND_DRIVER) {
+      return Error("Option " + option.first + " is not supported by " +
+                   driver);
+    } else {
+      data.push_back(option.second.empty()
+          ? option.first
+          : option.first + VOL_OPT_KEY_SEPARATOR + option.second);
+    }
+  }
+
+  string type;
+  if (driver == NATIVE_NFS_DRIVER) {
+    const size_t separator = source.find(':');
+    if (separator == string::npos || separator == 0 ||
+        !strings::startsWith(source.substr(separator + 1), "/")) {
+      return Error(driver + " requires a " + NATIVE_SOURCE_OPTION +
+                   "=<host>:/<export> option");
+    }
+
+    Try<string> address = resolveNfsServer(source.substr(0, separator));
+    if (address.isError()) {
+      return Error(address.error());
+    }
+
+    type = "nfs";
+    data.push_back("addr=" + address.get());
+  } else if (driver == NATIVE_BIND_DRIVER) {
+    Try<string> resolved = bindSource(source);
+    if (resolved.isError()) {
+      return Error(resolved.error());
+    }
+
+    source = resolved.get();
+    flags |= MS_BIND;
+  } else if (driver == NATIVE_TMPFS_DRIVER) {
+    type = "tmpfs";
+    source = "tmpfs";
+  } else {
+    return Error("Unknown native volume driver " + driver);
+  }
+
+  // A volume that is still mounted, e.g. when the reconciler remounts
+  // after a stale record, is returned as is, as dvdcli would do.
+  Result<mesos::internal::fs::MountInfoTable::Entry> existing =
+    findMount(target);
+  if (existing.isError()) {
+    return Error(existing.error());
+  } else if (existing.isSome()) {
+    LOG(INFO) << em.volumename() << " is already mounted at " << target;
+    return MountedVolume(target);
+  }
+
+  Try<Nothing> mkdir = os::mkdir(target);
+  if (mkdir.isError()) {
+    return Error("Failed to create mountpoint " + target + ": " +
+                 mkdir.error());
+  }
+
+  const string options = strings::join(VOL_OPTS_SEPARATOR, data);
+
+  LOG(INFO) << "Mounting " << source << " at " << target
+            << (type.empty() ? string() : " type " + type)
+            << (options.empty() ? string() : " with " + options);
+
+  // MS_BIND ignores every other flag, read only needs a remount.
+  Try<Nothing> mounted = mesos::internal::fs::mount(
+      source,
+      target,
+      type.empty() ? Option<string>::none() : Option<string>(type),
+      (flags & MS_BIND) ? MS_BIND : flags,
+      options.empty() ? NULL : options.c_str());
+
+  if (mounted.isSome() && (flags & MS_BIND) && flags != MS_BIND) {
+    mounted = mesos::internal::fs::mount(
+        None(), target, None(), flags | MS_REMOUNT, NULL);
+
+    if (mounted.isError()) {
+      mesos::internal::fs::unmount(target);
+    }
+  }
+
+  if (mounted.isError()) {
+    os::rmdir(target, false);
+    return Error("Failed to mount " + source + " at " + target + ": " +
+                 mounted.error());
+  }
+
+  return MountedVolume(target);
+}
+
+Try<Nothing> NativeVolumeDriver::unmount(const ExternalMount& em)
+{
+  const string target =
+    em.mountpoint().empty() ? mountPoint(em) : em.mountpoint();
+
+  LOG(INFO) << "Unmounting " << target;
+
+  Try<Nothing> unmounted = mesos::internal::fs::unmount(target);
+  if (unmounted.isError()) {
+    return Error("Failed to unmount " + target + ": " + unmounted.error());
+  }
+
+  // Only the empty mountpoint is removed, never the volume contents.
+  os::rmdir(target, false);
+
+  return Nothing();
+}
+
+} /* namespace slave */
+} /* namespace mesos */
@@ -0,0 +1,239 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_VOLUME_DRIVER_HPP_
+#define SRC_VOLUME_DRIVER_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stout/error.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "interface.hpp"
+
+namespace mesos {
+namespace slave {
+
+static constexpr char DVDCLI_MOUNT_CMD[]          = "/usr/bin/dvdcli mount";
+static constexpr char DVDCLI_UNMOUNT_CMD[]        = "/usr/bin/dvdcli unmount";
+
+static constexpr char VOL_NAME_CMD_OPTION[]       = "--volumename=";
+static constexpr char VOL_DRIVER_CMD_OPTION[]     = "--volumedriver=";
+static constexpr char VOL_OPTS_CMD_OPTION[]       = "--volumeopts=";
+
+// DVDI_VOLUME_OPTS is a comma separated list of key=value pairs,
+// e.g. size=5,iops=150,newfstype=xfs.
+static constexpr char VOL_OPTS_SEPARATOR[]        = ",";
+static constexpr char VOL_OPT_KEY_SEPARATOR[]     = "=";
+
+// Volume drivers built into the isolator, which mount with mount(2)
+// rather than through dvdcli and a volume plugin.
+static constexpr char NATIVE_DRIVER_PREFIX[]      = "native-";
+static constexpr char NATIVE_NFS_DRIVER[]         = "native-nfs";
+static constexpr char NATIVE_BIND_DRIVER[]        = "native-bind";
+static constexpr char NATIVE_TMPFS_DRIVER[]       = "native-tmpfs";
+static constexpr char NATIVE_LVM_DRIVER[]         = "native-lvm";
+static constexpr char NATIVE_MOUNT_PREFIX[]       = "/var/lib/dvdi/volumes/";
+
+// The option naming what to mount: host:/export for native-nfs,
+// a host directory for native-bind.
+static constexpr char NATIVE_SOURCE_OPTION[]      = "source";
+
+// Options in DVDI_VOLUME_OPTS that are acted on by the isolator itself,
+// and never passed to a driver.
+static constexpr char IO_PROFILE_OPTION[]         = "ioprofile";
+static constexpr char CACHE_OPTION[]              = "cache";
+static constexpr char CACHE_SIZE_OPTION[]         = "cachesize";
+static constexpr char POOLED_OPTION[]             = "pooled";
+static constexpr char CLONE_POLICY_OPTION[]       = "clonepolicy";
+static constexpr char ACCESS_MODE_OPTION[]        = "accessmode";
+
+// Names the snapshot a new volume is cloned from. It is passed on to
+// the driver, which does the cloning.
+static constexpr char FROM_SNAPSHOT_OPTION[]      = "fromsnapshot";
+
+// Values of CLONE_POLICY_OPTION. A clone is kept by default, and with
+// destroy is removed once its last user is gone.
+static constexpr char CLONE_KEEP[]                = "keep";
+static constexpr char CLONE_DESTROY[]             = "destroy";
+
+// Values of ACCESS_MODE_OPTION. Any number of ro mounts of a volume
+// share one attach, an rw mount has the volume to itself. Without the
+// option a mount shares with other mounts without one, as before.
+static constexpr char ACCESS_READ_ONLY[]          = "ro";
+static constexpr char ACCESS_READ_WRITE[]         = "rw";
+
+typedef std::vector<std::pair<std::string, std::string>> VolumeOptions;
+
+// Splits DVDI_VOLUME_OPTS into its key=value pairs, in order.
+// A pair without a value gets an empty one.
+VolumeOptions parseVolumeOptions(const std::string& options);
+
+// As above, leaving out the options acted on by the isolator.
+VolumeOptions parseDriverOptions(const std::string& options);
+
+// Returns the value of the named option, if present.
+Option<std::string> findVolumeOption(
+    const std::string& options,
+    const std::string& key);
+
+// A volume mounted by a driver.
+struct MountedVolume
+{
+  MountedVolume() : cloned(false) {}
+
+  explicit MountedVolume(const std::string& _mountpoint, bool _cloned = false)
+    : mountpoint(_mountpoint), cloned(_cloned) {}
+
+  std::string mountpoint;
+
+  // Whether this mount created the volume as a clone of the snapshot
+  // named by its fromsnapshot option. A volume that was found in place
+  // is not, whatever its options say.
+  bool cloned;
+};
+
+// Attaches and mounts volumes on behalf of the isolator, which calls it
+// only after the driver scheduler has admitted the operation.
+//
+// Drivers that can attach or detach several volumes in one request
+// override supportsBatch() and the batch methods. The isolator groups
+// the volumes of a container by driver and hands each group to the
+// batch methods of a driver that supports them, and otherwise makes one
+// call per volume.
+class VolumeDriver
+{
+public:
+  virtual ~VolumeDriver() {}
+
+  // Returns where the volume was mounted.
+  virtual Try<MountedVolume> mount(const ExternalMount& em) = 0;
+
+  virtual Try<Nothing> unmount(const ExternalMount& em) = 0;
+
+  virtual bool supportsBatch() const { return false; }
+
+  // The results are in the same order as the mounts.
+  virtual std::vector<Try<MountedVolume>> mountBatch(
+      const std::vector<ExternalMount>& mounts);
+
+  virtual std::vector<Try<Nothing>> unmountBatch(
+      const std::vector<ExternalMount>& mounts);
+
+  // Detaches the volume from whichever host has it attached, fencing
+  // off an agent whose lease on the volume has expired.
+  virtual Try<Nothing> forceDetach(const ExternalMount& em)
+  {
+    return Error("Volume driver " + em.volumedriver() +
+                 " can not force detach");
+  }
+
+  // Deletes a volume that is no longer mounted, and its data. Only
+  // called for clones the driver reported creating.
+  virtual Try<Nothing> remove(const ExternalMount& em)
+  {
+    return Error("Volume driver " + em.volumedriver() +
+                 " can not remove volumes");
+  }
+};
+
+// Placeholders in the force detach command of DvdcliVolumeDriver.
+static constexpr char COMMAND_DRIVER_PLACEHOLDER[] = "{driver}";
+static constexpr char COMMAND_VOLUME_PLACEHOLDER[] = "{volume}";
+
+// Mounts through dvdcli, which talks to the docker volume plugin
+// named by the mount's volume driver.
+//
+// dvdcli has no bulk call, and every dvdcli process is a request of its
+// own to the volume plugin, so volumes are mounted one call at a time,
+// each admitted by the driver scheduler on its own.
+//
+// dvdcli creates a volume that does not exist on mount, and does not
+// say whether it did, so its mounts never report a clone.
+class DvdcliVolumeDriver : public VolumeDriver
+{
+public:
+  // dvdcli has no force detach, so it is done by forceDetachCommand,
+  // e.g. "rexray volume detach --force {volume}", if given.
+  explicit DvdcliVolumeDriver(const std::string& _forceDetachCommand = "")
+    : forceDetachCommand(_forceDetachCommand) {}
+
+  virtual Try<MountedVolume> mount(const ExternalMount& em);
+
+  virtual Try<Nothing> unmount(const ExternalMount& em);
+
+  virtual Try<Nothing> forceDetach(const ExternalMount& em);
+
+private:
+  static std::string mountCommand(const ExternalMount& em);
+  static std::string unmountCommand(const ExternalMount& em);
+
+  // Runs command with the placeholders replaced by those of em.
+  static Try<Nothing> runVolumeCommand(
+      const std::string& command,
+      const ExternalMount& em);
+
+  const std::string forceDetachCommand;
+};
+
+// Mounts NFS exports, host directories and tmpfs with mount(2) and
+// umount2(2) directly, at NATIVE_MOUNT_PREFIX<driver>/<volumename>.
+//
+// DVDI_VOLUME_OPTS holds the source, the generic flags ro, nosuid,
+// nodev, noexec, noatime, nodiratime and relatime, and for native-nfs
+// and native-tmpfs any other options of the filesystem, which are
+// passed to the kernel as they are, e.g.
+// source=nfs1:/exports/data,vers=4.1,ro for native-nfs.
+//
+// native-bind only binds directories under one of bindAllowed, after
+// resolving symlinks, and binds nothing if bindAllowed is empty, as the
+// source comes from the task.
+class NativeVolumeDriver : public VolumeDriver
+{
+public:
+  explicit NativeVolumeDriver(
+      const std::vector<std::string>& _bindAllowed =
+        std::vector<std::string>())
+    : bindAllowed(_bindAllowed) {}
+
+  // Returns true if name is one of the native drivers, including
+  // native-lvm, which is served by ThinVolumeDriver.
+  static bool handles(const std::string& name);
+
+  virtual Try<MountedVolume> mount(const ExternalMount& em);
+
+  virtual Try<Nothing> unmount(const ExternalMount& em);
+
+private:
+  static std::string mountPoint(const ExternalMount& em);
+
+  // Returns the directory named by the source of a native-bind volume,
+  // with every symlink resolved, if it is under one of bindAllowed.
+  Try<std::string> bindSource(const std::string& source) const;
+
+  const std::vector<std::string> bindAllowed;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_VOLUME_DRIVER_HPP_ */
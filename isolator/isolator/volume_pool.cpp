@@ -0,0 +1,462 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/protobuf.hpp>
+#include <stout/result.hpp>
+#include <stout/strings.hpp>
+#include <stout/uuid.hpp>
+
+#include <slave/state.hpp>
+
+#include "volume_driver.hpp"
+#include "volume_pool.hpp"
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace slave {
+
+static constexpr char POOL_SIZE_OPTION[]          = "size";
+static constexpr char POOL_FSTYPE_OPTION[]        = "newfstype";
+static constexpr char POOL_COUNT_OPTION[]         = "count";
+
+static string aliasKey(const string& driver, const string& name)
+{
+  return driver + "/" + name;
+}
+
+string PoolClass::key() const
+{
+  return driver + "/" + size + "/" + fstype;
+}
+
+string PoolClass::options() const
+{
+  return string(POOL_SIZE_OPTION) + VOL_OPT_KEY_SEPARATOR + size +
+         VOL_OPTS_SEPARATOR + POOL_FSTYPE_OPTION + VOL_OPT_KEY_SEPARATOR +
+         fstype;
+}
+
+Try<vector<PoolClass>> VolumePool::parse(const string& value)
+{
+  vector<PoolClass> result;
+
+  foreach (const string& entry, strings::tokenize(value, ";")) {
+    vector<string> driverAndClass = strings::split(entry, ":");
+    if (driverAndClass.size() != 2 ||
+        strings::trim(driverAndClass[0]).empty()) {
+      return Error("Expecting <driver>:<class> but found '" + entry + "'");
+    }
+
+    PoolClass poolClass;
+    poolClass.driver = strings::trim(driverAndClass[0]);
+
+    foreach (const auto& option, parseVolumeOptions(driverAndClass[1])) {
+      if (option.first == POOL_SIZE_OPTION) {
+        poolClass.size = option.second;
+      } else if (option.first == POOL_FSTYPE_OPTION) {
+        poolClass.fstype = option.second;
+      } else if (option.first == POOL_COUNT_OPTION) {
+        Try<size_t> count = numify<size_t>(option.second);
+        if (count.isError()) {
+          return Error("Invalid count '" + option.second + "'");
+        }
+        poolClass.count = count.get();
+      } else {
+        return Error("Unknown pool class option '" + option.first + "'");
+      }
+    }
+
+    if (poolClass.size.empty() || poolClass.fstype.empty() ||
+        poolClass.count == 0) {
+      return Error("Pool class '" + entry + "' needs a size, a newfstype "
+                   "and a count of at least 1");
+    }
+
+    result.push_back(poolClass);
+  }
+
+  return result;
+}
+
+VolumePool::VolumePool(
+    const vector<PoolClass>& _classes,
+    const string& _checkpointPath,
+    const string& _aliasDirectory)
+  : classes(_classes),
+    checkpointPath(_checkpointPath),
+    aliasDirectory(_aliasDirectory) {}
+
+Try<Nothing> VolumePool::recover()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  available.clear();
+  aliases.clear();
+  claimed.clear();
+
+  if (!os::exists(checkpointPath)) {
+    return Nothing();
+  }
+
+  // checkpoint() writes the state as a length prefixed record.
+  Result<VolumePoolState> read =
+    ::protobuf::read<VolumePoolState>(checkpointPath);
+  if (read.isError()) {
+    return Error("Invalid protobuf data contained within " + checkpointPath +
+                 ": " + read.error());
+  }
+
+  // None for an empty file.
+  VolumePoolState state;
+  if (read.isSome()) {
+    state = read.get();
+  }
+
+  // Volumes of a class no longer configured are kept, and handed out
+  // again if the class comes back.
+  foreach (const PooledVolume& volume, state.available()) {
+    available[volume.poolclass()].push_back(volume.volumename());
+  }
+
+  foreach (const VolumeAlias& alias, state.alias()) {
+    aliases[aliasKey(alias.volumedriver(), alias.name())] = alias.volumename();
+  }
+
+  LOG(INFO) << "Recovered " << state.available_size() << " pooled volume(s) "
+            << "and " << state.alias_size() << " alias(es) from "
+            << checkpointPath;
+
+  return Nothing();
+}
+
+Option<PoolClass> VolumePool::findClass(
+    const string& driver,
+    const string& options) const
+{
+  const Option<string> size = findVolumeOption(options, POOL_SIZE_OPTION);
+  const Option<string> fstype = findVolumeOption(options, POOL_FSTYPE_OPTION);
+
+  foreach (const PoolClass& poolClass, classes) {
+    if (poolClass.driver == driver &&
+        size.isSome() && size.get() == poolClass.size &&
+        fstype.isSome() && fstype.get() == poolClass.fstype) {
+      return poolClass;
+    }
+  }
+
+  return None();
+}
+
+Try<string> VolumePool::resolve(
+    const string& driver,
+    const string& name,
+    const string& options,
+    vector<PoolClaim>* claims)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const string key = aliasKey(driver, name);
+  if (aliases.contains(key)) {
+    // Another container may now be using the volume.
+    claimed.erase(key);
+    return aliases[key];
+  }
+
+  // The task may have used the name on another agent before.
+  Result<string> shared = readAlias(driver, name);
+  if (shared.isError()) {
+    return Error(shared.error());
+  } else if (shared.isSome()) {
+    LOG(INFO) << "Volume " << name << " is pooled volume " << shared.get()
+              << ", as recorded in " << aliasDirectory;
+    aliases[key] = shared.get();
+    checkpoint();
+    return shared.get();
+  }
+
+  Option<PoolClass> poolClass = findClass(driver, options);
+  if (poolClass.isNone()) {
+    return Error("No volume pool class for driver " + driver +
+                 " with the size and newfstype of " + name);
+  }
+
+  string volumename;
+  bool fromPool = false;
+  vector<string>& pool = available[poolClass.get().key()];
+  if (pool.empty()) {
+    volumename = generateName();
+    LOG(WARNING) << "Volume pool " << poolClass.get().key() << " is empty, "
+                 << name << " will be created on mount as " << volumename;
+  } else {
+    volumename = pool.front();
+    pool.erase(pool.begin());
+    fromPool = true;
+  }
+
+  Try<string> published = publishAlias(driver, name, volumename);
+  if (fromPool && (published.isError() || published.get() != volumename)) {
+    pool.insert(pool.begin(), volumename);
+  }
+
+  if (published.isError()) {
+    return Error("Failed to record the alias of " + name + ": " +
+                 published.error());
+  }
+
+  if (published.get() != volumename) {
+    LOG(INFO) << "Volume " << name << " was given pooled volume "
+              << published.get() << " by another agent meanwhile";
+  } else if (fromPool) {
+    LOG(INFO) << "Volume " << name << " claimed pooled volume " << volumename;
+  }
+
+  aliases[key] = published.get();
+  checkpoint();
+
+  if (claims != NULL && published.get() == volumename) {
+    PoolClaim claim;
+    claim.driver = driver;
+    claim.name = name;
+    claim.volumename = volumename;
+    claim.poolClass = fromPool ? poolClass.get().key() : "";
+    claims->push_back(claim);
+    claimed.insert(key);
+  }
+
+  return published.get();
+}
+
+void VolumePool::giveBack(const PoolClaim& claim)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const string key = aliasKey(claim.driver, claim.name);
+  if (!claimed.contains(key)) {
+    return;
+  }
+  claimed.erase(key);
+
+  // A volume other agents may still find under the name is kept as its
+  // alias, rather than handed out again.
+  const string file = aliasPath(claim.driver, claim.name);
+  Try<Nothing> rm = os::rm(file);
+  if (rm.isError() && os::exists(file)) {
+    LOG(ERROR) << "Failed to remove the alias in " << file << ", "
+               << claim.name << " keeps pooled volume " << claim.volumename
+               << ": " << rm.error();
+    return;
+  }
+
+  aliases.erase(key);
+  if (!claim.poolClass.empty()) {
+    vector<string>& pool = available[claim.poolClass];
+    pool.insert(pool.begin(), claim.volumename);
+  }
+
+  LOG(INFO) << "Volume " << claim.name << " gave back pooled volume "
+            << claim.volumename;
+
+  checkpoint();
+}
+
+void VolumePool::keep(const PoolClaim& claim)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  claimed.erase(aliasKey(claim.driver, claim.name));
+}
+
+vector<std::pair<PoolClass, size_t>> VolumePool::shortfall() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  vector<std::pair<PoolClass, size_t>> result;
+  foreach (const PoolClass& poolClass, classes) {
+    const size_t have = available.contains(poolClass.key())
+      ? available.at(poolClass.key()).size()
+      : 0;
+
+    if (have < poolClass.count) {
+      result.push_back(std::make_pair(poolClass, poolClass.count - have));
+    }
+  }
+
+  return result;
+}
+
+void VolumePool::add(const PoolClass& poolClass, const string& volumename)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  available[poolClass.key()].push_back(volumename);
+  checkpoint();
+}
+
+JSON::Object VolumePool::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  JSON::Object result;
+
+  JSON::Array pools;
+  foreach (const PoolClass& poolClass, classes) {
+    JSON::Object pool;
+    pool.values["class"] = poolClass.key();
+    pool.values["target"] = JSON::Number(poolClass.count);
+    pool.values["available"] = JSON::Number(
+        available.contains(poolClass.key())
+          ? available.at(poolClass.key()).size()
+          : 0);
+    pools.values.push_back(pool);
+  }
+
+  result.values["pools"] = pools;
+  result.values["aliases"] = JSON::Number(aliases.size());
+
+  return result;
+}
+
+string VolumePool::aliasPath(const string& driver, const string& name) const
+{
+  return path::join(aliasDirectory, driver, name);
+}
+
+Result<string> VolumePool::readAlias(
+    const string& driver,
+    const string& name) const
+{
+  const string file = aliasPath(driver, name);
+  if (!os::exists(file)) {
+    return None();
+  }
+
+  Try<string> read = os::read(file);
+  if (read.isError()) {
+    return Error("Failed to read the alias in " + file + ": " + read.error());
+  }
+
+  const string volumename = strings::trim(read.get());
+  if (volumename.empty()) {
+    return Error("The alias in " + file + " is empty");
+  }
+
+  return volumename;
+}
+
+Try<string> VolumePool::publishAlias(
+    const string& driver,
+    const string& name,
+    const string& volumename) const
+{
+  const string directory = path::join(aliasDirectory, driver);
+  Try<Nothing> mkdir = os::mkdir(directory);
+  if (mkdir.isError()) {
+    return Error("Failed to create " + directory + ": " + mkdir.error());
+  }
+
+  // Written in full first, then linked into place, which fails if
+  // another agent has recorded an alias, atomically even over NFS.
+  Try<string> temporary = os::mktemp(path::join(directory, ".XXXXXX"));
+  if (temporary.isError()) {
+    return Error("Failed to create a file in " + directory + ": " +
+                 temporary.error());
+  }
+
+  Try<Nothing> write = os::write(temporary.get(), volumename);
+  if (write.isError()) {
+    os::rm(temporary.get());
+    return Error("Failed to write " + temporary.get() + ": " + write.error());
+  }
+
+  const string file = aliasPath(driver, name);
+  const int linked = ::link(temporary.get().c_str(), file.c_str());
+  const int error = errno;
+  os::rm(temporary.get());
+
+  if (linked == 0) {
+    return volumename;
+  } else if (error != EEXIST) {
+    return Error("Failed to link " + file + ": " + ::strerror(error));
+  }
+
+  Result<string> existing = readAlias(driver, name);
+  if (!existing.isSome()) {
+    return Error(existing.isError()
+        ? existing.error()
+        : "The alias in " + file + " went away");
+  }
+
+  return existing.get();
+}
+
+string VolumePool::generateName()
+{
+  return POOL_VOLUME_PREFIX + UUID::random().toString();
+}
+
+void VolumePool::checkpoint() const
+{
+  VolumePoolState state;
+
+  foreach (const auto& pool, available) {
+    const vector<string> classKey = strings::split(pool.first, "/");
+
+    foreach (const string& volumename, pool.second) {
+      PooledVolume* volume = state.add_available();
+      volume->set_volumedriver(classKey[0]);
+      volume->set_volumename(volumename);
+      volume->set_poolclass(pool.first);
+    }
+  }
+
+  foreach (const auto& alias, aliases) {
+    const size_t separator = alias.first.find('/');
+
+    VolumeAlias* entry = state.add_alias();
+    entry->set_volumedriver(alias.first.substr(0, separator));
+    entry->set_name(alias.first.substr(separator + 1));
+    entry->set_volumename(alias.second);
+  }
+
+  Try<Nothing> checkpointed =
+    mesos::internal::slave::state::checkpoint(checkpointPath, state);
+  if (checkpointed.isError()) {
+    LOG(ERROR) << "Failed to checkpoint the volume pool to "
+               << checkpointPath << ": " << checkpointed.error();
+  }
+}
+
+} /* namespace slave */
+} /* namespace mesos */
@@ -0,0 +1,174 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_VOLUME_POOL_HPP_
+#define SRC_VOLUME_POOL_HPP_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/json.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
+
+#include "interface.hpp"
+
+namespace mesos {
+namespace slave {
+
+static constexpr char POOL_VOLUME_PREFIX[]        = "dvdi-pool-";
+
+// Volumes of one driver, size and filesystem kept ready in the pool.
+struct PoolClass
+{
+  std::string driver;
+  std::string size;
+  std::string fstype;
+
+  // How many blank volumes to keep.
+  size_t count = 0;
+
+  // <driver>/<size>/<fstype>
+  std::string key() const;
+
+  // The DVDI_VOLUME_OPTS that create a volume of this class.
+  std::string options() const;
+};
+
+// An alias resolve() has just recorded, which giveBack() undoes.
+struct PoolClaim
+{
+  std::string driver;
+  std::string name;
+  std::string volumename;
+
+  // The key of the class whose pool the volume was taken from, empty
+  // if the pool was empty and the volume does not exist yet.
+  std::string poolClass;
+};
+
+// Blank volumes created and formatted ahead of time, so that a task
+// asking for a new volume does not wait for the volume driver to create
+// and format it.
+//
+// Volume drivers cannot rename a volume, so a claimed pool volume keeps
+// its own name and the pool records an alias from the name the task
+// asked for. Later requests for that name resolve to the same volume.
+// The pool and the aliases are checkpointed at the path given.
+//
+// Each alias is also kept in a file of its own under aliasDirectory,
+// shared by every agent, so that a task rescheduled to another agent
+// gets its volume back rather than a blank one. The first agent to
+// record an alias for a name wins.
+class VolumePool
+{
+public:
+  // Parses <driver>:size=<s>,newfstype=<fs>,count=<n>[;<driver>:...]
+  static Try<std::vector<PoolClass>> parse(const std::string& value);
+
+  VolumePool(
+      const std::vector<PoolClass>& classes,
+      const std::string& checkpointPath,
+      const std::string& aliasDirectory);
+
+  // Loads the checkpoint, if there is one.
+  Try<Nothing> recover();
+
+  // Returns the volume backing name, claiming a pool volume for it if it
+  // has none yet. If the pool of its class is empty, a new pool volume
+  // name is aliased and returned, which the driver creates on mount.
+  // Fails if no pool class matches the driver and options. A new alias
+  // is appended to claims, if given.
+  Try<std::string> resolve(
+      const std::string& driver,
+      const std::string& name,
+      const std::string& options,
+      std::vector<PoolClaim>* claims = NULL);
+
+  // Forgets the alias of claim, here and in aliasDirectory, and puts
+  // the volume back at the front of its pool. Does nothing once the
+  // name has been resolved again, or the claim kept.
+  void giveBack(const PoolClaim& claim);
+
+  // Makes the alias of claim permanent.
+  void keep(const PoolClaim& claim);
+
+  // The classes whose pool is short, with the number of volumes missing.
+  std::vector<std::pair<PoolClass, size_t>> shortfall() const;
+
+  // Adds a newly created volume to the pool of its class.
+  void add(const PoolClass& poolClass, const std::string& volumename);
+
+  // Available volumes per class, and the number of aliases.
+  JSON::Object stats() const;
+
+  // A new, unique volume name for a pool volume.
+  static std::string generateName();
+
+private:
+  Option<PoolClass> findClass(
+      const std::string& driver,
+      const std::string& options) const;
+
+  // Must be called with mutex held.
+  void checkpoint() const;
+
+  // The file in aliasDirectory holding the alias of name.
+  std::string aliasPath(
+      const std::string& driver,
+      const std::string& name) const;
+
+  // The alias of name another agent, or this one, has recorded in
+  // aliasDirectory, None if there is none.
+  Result<std::string> readAlias(
+      const std::string& driver,
+      const std::string& name) const;
+
+  // Records volumename as the alias of name in aliasDirectory, unless
+  // there is one already, and returns the alias name now has.
+  Try<std::string> publishAlias(
+      const std::string& driver,
+      const std::string& name,
+      const std::string& volumename) const;
+
+  const std::vector<PoolClass> classes;
+  const std::string checkpointPath;
+  const std::string aliasDirectory;
+
+  mutable std::mutex mutex;
+
+  // Available volume names by class key, oldest first.
+  hashmap<std::string, std::vector<std::string>> available;
+
+  // Volume names by <driver>/<name> of the requested volume.
+  hashmap<std::string, std::string> aliases;
+
+  // The aliases claims were made for that giveBack() may still undo.
+  hashset<std::string> claimed;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_VOLUME_POOL_HPP_ */
@@ -0,0 +1,110 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WORK_QUEUE_HPP_
+#define SRC_WORK_QUEUE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mesos {
+namespace slave {
+
+// A fixed set of threads running jobs that block on volume driver calls.
+//
+// Driver calls can block for a long time (waiting for admission, or for
+// the storage control plane), so they are run on threads of our own
+// rather than on libprocess worker threads, which would starve every
+// other process on the agent.
+//
+// Jobs still queued when the WorkQueue is destroyed are dropped.
+class WorkQueue
+{
+public:
+  explicit WorkQueue(size_t threads)
+  {
+    for (size_t i = 0; i < threads; i++) {
+      workers.push_back(std::thread(&WorkQueue::run, this));
+    }
+  }
+
+  ~WorkQueue()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+
+    changed.notify_all();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void submit(const std::function<void()>& job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(job);
+    }
+
+    changed.notify_one();
+  }
+
+private:
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+
+  void run()
+  {
+    while (true) {
+      std::function<void()> job;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+        if (stopping) {
+          return;
+        }
+
+        job = jobs.front();
+        jobs.pop_front();
+      }
+
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::function<void()>> jobs;
+  bool stopping = false;
+
+  std::vector<std::thread> workers;
+};
+
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* SRC_WORK_QUEUE_HPP_ */
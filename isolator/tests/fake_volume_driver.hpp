@@ -0,0 +1,166 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TESTS_FAKE_VOLUME_DRIVER_HPP_
+#define TESTS_FAKE_VOLUME_DRIVER_HPP_
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stout/error.hpp>
+#include <stout/hashset.hpp>
+#include <stout/nothing.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/try.hpp>
+
+#include "isolator/volume_driver.hpp"
+
+namespace mesos {
+namespace slave {
+namespace tests {
+
+// How far a call to the fake driver has got when its hook runs.
+enum DriverPhase
+{
+  BEFORE_MOUNT,
+  AFTER_MOUNT,
+  BEFORE_UNMOUNT,
+  AFTER_UNMOUNT
+};
+
+// A volume driver that attaches nothing, and only keeps track of which
+// volumes a real one would have attached. Each volume is given a
+// directory of its own under root as its mountpoint.
+//
+// The hook, if set, runs on the calling thread before and after each
+// mount and unmount takes effect. Unmounting a volume that is not
+// attached succeeds, as it does with dvdcli.
+class FakeVolumeDriver : public VolumeDriver
+{
+public:
+  typedef std::function<void(DriverPhase, const ExternalMount&)> Hook;
+
+  explicit FakeVolumeDriver(
+      const std::string& _root,
+      const hashset<std::string>& _attached = hashset<std::string>())
+    : root(_root), attached(_attached) {}
+
+  // Names the volume of em in attachedVolumes().
+  static std::string volume(const ExternalMount& em)
+  {
+    return em.volumedriver() + "/" + em.volumename();
+  }
+
+  void setHook(const Hook& _hook)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    hook = _hook;
+  }
+
+  virtual Try<MountedVolume> mount(const ExternalMount& em)
+  {
+    call(BEFORE_MOUNT, em);
+
+    const std::string mountpoint =
+      path::join(root, em.volumedriver(), em.volumename());
+
+    Try<Nothing> mkdir = os::mkdir(mountpoint);
+    if (mkdir.isError()) {
+      return Error("Failed to create " + mountpoint + ": " + mkdir.error());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      calls++;
+
+      // The isolator lost track of the attach it already made.
+      if (attached.contains(volume(em))) {
+        errors.push_back("volume " + volume(em) + " attached twice");
+      }
+      attached.insert(volume(em));
+    }
+
+    call(AFTER_MOUNT, em);
+    return MountedVolume(mountpoint);
+  }
+
+  virtual Try<Nothing> unmount(const ExternalMount& em)
+  {
+    call(BEFORE_UNMOUNT, em);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      calls++;
+      attached.erase(volume(em));
+    }
+
+    call(AFTER_UNMOUNT, em);
+    return Nothing();
+  }
+
+  hashset<std::string> attachedVolumes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return attached;
+  }
+
+  // Mounts and unmounts made so far.
+  size_t callCount() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return calls;
+  }
+
+  std::vector<std::string> errorList() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return errors;
+  }
+
+private:
+  void call(DriverPhase phase, const ExternalMount& em)
+  {
+    Hook current;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = hook;
+    }
+
+    // Run without the lock, the hook may look at the attached volumes.
+    if (current) {
+      current(phase, em);
+    }
+  }
+
+  const std::string root;
+
+  mutable std::mutex mutex;
+  hashset<std::string> attached;
+  size_t calls = 0;
+  std::vector<std::string> errors;
+  Hook hook;
+};
+
+} /* namespace tests */
+} /* namespace slave */
+} /* namespace mesos */
+
+#endif /* TESTS_FAKE_VOLUME_DRIVER_HPP_ */
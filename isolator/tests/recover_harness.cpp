@@ -0,0 +1,672 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fault injection and recovery timing harness for the recover() of
+// DockerVolumeDriverIsolator, run against FakeVolumeDriver.
+//
+// A workload of prepare() and cleanup() calls is run once, and an agent
+// crash is recorded before and after every mount and unmount it makes,
+// and after each of its steps. A crash is what a restarted agent finds:
+// the checkpoint file as it was, and the volumes the driver had
+// attached. checkpoint() replaces the file with a rename, so a crash in
+// the middle of one leaves the previous file and a half written
+// temporary one next to it, and each crash is also tried that way.
+//
+// A new isolator recovers from each crash. Once its background unmounts
+// are done, exactly the volumes of the containers that were running must
+// be attached, and none once those are cleaned up in turn. A container
+// that was in prepare() is tried both as gone, and as destroyed by the
+// agent after recovery.
+//
+// recover() is then timed over checkpoints of 10 to 10000 mounts.
+//
+// Exits with a failure if any crash was not recovered from.
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <mesos/mesos.hpp>
+#include <mesos/slave/isolator.hpp>
+
+#include <process/future.hpp>
+#include <process/owned.hpp>
+
+#include <stout/check.hpp>
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/try.hpp>
+
+#include <slave/paths.hpp>
+#include <slave/state.hpp>
+
+#include "isolator/docker_volume_driver_isolator.hpp"
+
+#include "fake_volume_driver.hpp"
+
+using std::list;
+using std::string;
+using std::vector;
+
+using process::Future;
+using process::Owned;
+
+using namespace mesos;
+using namespace mesos::slave;
+using namespace mesos::slave::tests;
+
+namespace {
+
+// Every volume uses it, the fake driver takes them all whatever the name.
+const char FAKE_DRIVER[] = "fake";
+
+// How long background unmounts get to finish.
+const Duration SETTLE_TIMEOUT = Seconds(30);
+
+// How long the driver must go without calls before the isolator is
+// taken to be done with it.
+const Duration QUIET_PERIOD = Milliseconds(200);
+
+// A call the agent makes into the isolator.
+struct Step
+{
+  // cleanup() otherwise.
+  bool prepare;
+  string container;
+  vector<string> volumes;
+
+  string name() const
+  {
+    return string(prepare ? "prepare(" : "cleanup(") + container + ")";
+  }
+};
+
+// Shares volumes between containers, and attaches volumes again after
+// they were detached.
+vector<Step> workload()
+{
+  return {
+    {true,  "c1", {"v1", "v2"}},
+    {true,  "c2", {"v2", "v3"}},
+    {false, "c1", {}},
+    {true,  "c3", {"v1", "v4"}},
+    {false, "c2", {}},
+    {true,  "c4", {"v3", "v4"}},
+    {false, "c3", {}},
+    {false, "c4", {}},
+  };
+}
+
+string volume(const string& name)
+{
+  return string(FAKE_DRIVER) + "/" + name;
+}
+
+ContainerID containerId(const string& container)
+{
+  ContainerID id;
+  id.set_value(container);
+  return id;
+}
+
+ExecutorInfo executorInfo(const string& container)
+{
+  ExecutorInfo info;
+  info.mutable_executor_id()->set_value(container);
+  info.mutable_command()->set_value("true");
+  return info;
+}
+
+// Asks for the volumes of step through the task environment.
+ExecutorInfo executorInfo(const Step& step)
+{
+  ExecutorInfo info = executorInfo(step.container);
+  Environment* environment = info.mutable_command()->mutable_environment();
+
+  for (size_t i = 0; i < step.volumes.size(); i++) {
+    const string suffix = stringify(i + 1);
+
+    Environment::Variable* name = environment->add_variables();
+    name->set_name(VOL_NAME_ENV_VAR_NAME + suffix);
+    name->set_value(step.volumes[i]);
+
+    Environment::Variable* driver = environment->add_variables();
+    driver->set_name(VOL_DRIVER_ENV_VAR_NAME + suffix);
+    driver->set_value(FAKE_DRIVER);
+  }
+
+  return info;
+}
+
+ContainerState containerState(const string& container)
+{
+  ContainerState state;
+  state.mutable_executor_info()->CopyFrom(executorInfo(container));
+  state.mutable_container_id()->CopyFrom(containerId(container));
+  state.set_pid(0);
+  state.set_directory("/");
+  return state;
+}
+
+// The isolator keeps its checkpoint under workDir, which must end in /.
+string checkpointPath(const string& workDir)
+{
+  return path::join(
+      mesos::internal::slave::paths::getMetaRootDir(workDir),
+      DVDI_MOUNTLIST_FILENAME);
+}
+
+// Creates an isolator that checkpoints under workDir, without the
+// reconciler and flusher, which would make driver calls of their own.
+Try<Isolator*> createIsolator(
+    const string& workDir,
+    const Owned<VolumeDriver>& driver)
+{
+  Parameters parameters;
+
+  Parameter* parameter = parameters.add_parameter();
+  parameter->set_key(DVDI_WORKDIR_PARAM_NAME);
+  parameter->set_value(workDir);
+
+  parameter = parameters.add_parameter();
+  parameter->set_key(RECONCILE_INTERVAL_PARAM_NAME);
+  parameter->set_value("0secs");
+
+  parameter = parameters.add_parameter();
+  parameter->set_key(FLUSH_INTERVAL_PARAM_NAME);
+  parameter->set_value("0secs");
+
+  return DockerVolumeDriverIsolator::create(parameters, driver);
+}
+
+// Waits for driver to go QUIET_PERIOD without calls with expected
+// attached, as recover() and cleanup() leave the unmounts to workers.
+bool settle(const FakeVolumeDriver& driver, const hashset<string>& expected)
+{
+  Stopwatch timeout;
+  timeout.start();
+
+  Stopwatch quiet;
+  quiet.start();
+  size_t calls = driver.callCount();
+
+  while (timeout.elapsed() < SETTLE_TIMEOUT) {
+    os::sleep(Milliseconds(10));
+
+    if (driver.callCount() != calls) {
+      calls = driver.callCount();
+      quiet.start();
+    } else if (quiet.elapsed() >= QUIET_PERIOD &&
+               driver.attachedVolumes() == expected) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+string difference(
+    const hashset<string>& attached,
+    const hashset<string>& expected)
+{
+  vector<string> leaked;
+  foreach (const string& name, attached) {
+    if (!expected.contains(name)) {
+      leaked.push_back(name);
+    }
+  }
+
+  vector<string> lost;
+  foreach (const string& name, expected) {
+    if (!attached.contains(name)) {
+      lost.push_back(name);
+    }
+  }
+
+  return "left attached " + stringify(leaked) +
+         ", detached while in use " + stringify(lost);
+}
+
+// What a restarted agent finds after a crash at one point of the workload.
+struct Crash
+{
+  string point;
+
+  // The checkpoint file, None if it had not been written yet.
+  Option<string> checkpoint;
+
+  hashset<string> attached;
+
+  // Containers prepared and not yet cleaned up, with their volumes.
+  hashmap<string, vector<string>> running;
+
+  // The container in prepare() at the time.
+  Option<string> preparing;
+
+  hashset<string> runningVolumes() const
+  {
+    hashset<string> volumes;
+    foreachvalue (const vector<string>& names, running) {
+      foreach (const string& name, names) {
+        volumes.insert(volume(name));
+      }
+    }
+    return volumes;
+  }
+};
+
+// Records a crash at every point of the workload. The workload waits
+// for each step to finish, so there is only ever one thread in the
+// isolator, and the checkpoint and attached volumes it records agree.
+class Recorder
+{
+public:
+  Recorder(const string& _checkpointPath, const FakeVolumeDriver& _driver)
+    : checkpointPath(_checkpointPath), driver(_driver) {}
+
+  void starting(const Step& step)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    current = step.name();
+
+    if (step.prepare) {
+      preparing = step.container;
+    } else {
+      running.erase(step.container);
+    }
+  }
+
+  void finished(const Step& step)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (step.prepare) {
+        running[step.container] = step.volumes;
+        preparing = None();
+      }
+    }
+
+    record("after");
+  }
+
+  void record(const string& point)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Crash crash;
+    crash.point = point + " " + current;
+    crash.attached = driver.attachedVolumes();
+    crash.running = running;
+    crash.preparing = preparing;
+
+    if (os::exists(checkpointPath)) {
+      Try<string> read = os::read(checkpointPath);
+      CHECK_SOME(read);
+      crash.checkpoint = read.get();
+    }
+
+    crashes.push_back(crash);
+  }
+
+  vector<Crash> crashes;
+
+private:
+  const string checkpointPath;
+  const FakeVolumeDriver& driver;
+
+  std::mutex mutex;
+  string current;
+  hashmap<string, vector<string>> running;
+  Option<string> preparing;
+};
+
+string phaseName(DriverPhase phase)
+{
+  switch (phase) {
+    case BEFORE_MOUNT:   return "before mount";
+    case AFTER_MOUNT:    return "after mount";
+    case BEFORE_UNMOUNT: return "before unmount";
+    case AFTER_UNMOUNT:  return "after unmount";
+  }
+  return "";
+}
+
+// Runs the workload and returns the crashes recorded along the way.
+Try<vector<Crash>> recordCrashes(const string& directory)
+{
+  const string workDir = path::join(directory, "work") + "/";
+
+  FakeVolumeDriver* fake = new FakeVolumeDriver(
+      path::join(directory, "volumes"));
+  Owned<VolumeDriver> driver(fake);
+
+  Recorder recorder(checkpointPath(workDir), *fake);
+  fake->setHook([&recorder](DriverPhase phase, const ExternalMount& em) {
+    recorder.record(phaseName(phase) + " of " + FakeVolumeDriver::volume(em) +
+                    " in");
+  });
+
+  Try<Isolator*> create = createIsolator(workDir, driver);
+  if (create.isError()) {
+    return Error("Failed to create the isolator: " + create.error());
+  }
+  Owned<Isolator> isolator(create.get());
+
+  Future<Nothing> recovered =
+    isolator->recover(list<ContainerState>(), hashset<ContainerID>());
+  if (!recovered.await(SETTLE_TIMEOUT) || !recovered.isReady()) {
+    return Error("Initial recover() did not succeed");
+  }
+
+  foreach (const Step& step, workload()) {
+    recorder.starting(step);
+
+    bool done = false;
+    if (step.prepare) {
+      Future<Option<ContainerPrepareInfo>> prepared = isolator->prepare(
+          containerId(step.container), executorInfo(step), "/", None());
+      done = prepared.await(SETTLE_TIMEOUT) && prepared.isReady();
+    } else {
+      Future<Nothing> cleaned = isolator->cleanup(containerId(step.container));
+      done = cleaned.await(SETTLE_TIMEOUT) && cleaned.isReady();
+    }
+
+    if (!done) {
+      return Error(step.name() + " of the workload did not succeed");
+    }
+
+    recorder.finished(step);
+  }
+
+  fake->setHook(FakeVolumeDriver::Hook());
+
+  if (!fake->attachedVolumes().empty() || !fake->errorList().empty()) {
+    return Error("The workload itself left " +
+                 stringify(fake->attachedVolumes().size()) +
+                 " volume(s) attached, with driver errors " +
+                 stringify(fake->errorList()));
+  }
+
+  return recorder.crashes;
+}
+
+// Restarts an isolator from crash, and returns what went wrong, if
+// anything. With halfWritten, a torn temporary checkpoint is left next
+// to the checkpoint. With destroyPreparing, the container that was in
+// prepare() is recovered and then cleaned up, rather than gone.
+Option<Error> recoverFrom(
+    const Crash& crash,
+    bool halfWritten,
+    bool destroyPreparing)
+{
+  Try<string> directory = os::mkdtemp();
+  if (directory.isError()) {
+    return Error("Failed to create a directory: " + directory.error());
+  }
+
+  const string workDir = path::join(directory.get(), "work") + "/";
+  const string checkpoint = checkpointPath(workDir);
+  const string meta = Path(checkpoint).dirname();
+
+  Try<Nothing> mkdir = os::mkdir(meta);
+  if (mkdir.isError()) {
+    return Error("Failed to create " + meta + ": " + mkdir.error());
+  }
+
+  if (crash.checkpoint.isSome()) {
+    Try<Nothing> write = os::write(checkpoint, crash.checkpoint.get());
+    if (write.isError()) {
+      return Error("Failed to write " + checkpoint + ": " + write.error());
+    }
+  }
+
+  if (halfWritten) {
+    Try<string> temporary = os::mktemp(path::join(meta, "XXXXXX"));
+    if (temporary.isError()) {
+      return Error("Failed to create a temporary file: " + temporary.error());
+    }
+
+    const string contents =
+      crash.checkpoint.getOrElse(string("\x08\x00\x00\x00", 4));
+    Try<Nothing> write =
+      os::write(temporary.get(), contents.substr(0, contents.size() / 2));
+    if (write.isError()) {
+      return Error("Failed to write " + temporary.get() + ": " + write.error());
+    }
+  }
+
+  FakeVolumeDriver* fake = new FakeVolumeDriver(
+      path::join(directory.get(), "volumes"), crash.attached);
+  Owned<VolumeDriver> driver(fake);
+
+  Try<Isolator*> create = createIsolator(workDir, driver);
+  if (create.isError()) {
+    return Error("Failed to create the isolator: " + create.error());
+  }
+
+  Option<Error> error = None();
+  {
+    Owned<Isolator> isolator(create.get());
+
+    list<ContainerState> states;
+    foreachkey (const string& container, crash.running) {
+      states.push_back(containerState(container));
+    }
+
+    if (destroyPreparing && crash.preparing.isSome()) {
+      states.push_back(containerState(crash.preparing.get()));
+    }
+
+    Future<Nothing> recovered =
+      isolator->recover(states, hashset<ContainerID>());
+
+    list<Future<Nothing>> cleanups;
+    if (destroyPreparing && crash.preparing.isSome()) {
+      cleanups.push_back(
+          isolator->cleanup(containerId(crash.preparing.get())));
+    }
+
+    const hashset<string> expected = crash.runningVolumes();
+
+    if (!recovered.await(SETTLE_TIMEOUT) || !recovered.isReady()) {
+      error = Error("recover() did not succeed");
+    } else if (!settle(*fake, expected)) {
+      error = Error("After recover(): " +
+                    difference(fake->attachedVolumes(), expected));
+    } else {
+      foreachkey (const string& container, crash.running) {
+        cleanups.push_back(isolator->cleanup(containerId(container)));
+      }
+
+      if (!settle(*fake, hashset<string>())) {
+        error = Error("After cleaning up every container: " +
+                      difference(fake->attachedVolumes(), hashset<string>()));
+      }
+    }
+
+    foreach (Future<Nothing>& cleanup, cleanups) {
+      if (error.isNone() &&
+          (!cleanup.await(SETTLE_TIMEOUT) || !cleanup.isReady())) {
+        error = Error("cleanup() did not succeed");
+      }
+    }
+  }
+
+  if (error.isNone() && !fake->errorList().empty()) {
+    error = Error("Driver errors " + stringify(fake->errorList()));
+  }
+
+  os::rmdir(directory.get());
+  return error;
+}
+
+// Restarts from every recorded crash, returns the number that failed.
+size_t runCrashes()
+{
+  Try<string> directory = os::mkdtemp();
+  CHECK_SOME(directory);
+
+  Try<vector<Crash>> crashes = recordCrashes(directory.get());
+  os::rmdir(directory.get());
+
+  if (crashes.isError()) {
+    std::cerr << crashes.error() << std::endl;
+    return 1;
+  }
+
+  size_t runs = 0;
+  size_t failures = 0;
+
+  foreach (const Crash& crash, crashes.get()) {
+    for (bool halfWritten : {false, true}) {
+      for (bool destroyPreparing : {false, true}) {
+        if (destroyPreparing && crash.preparing.isNone()) {
+          continue;
+        }
+
+        runs++;
+
+        Option<Error> error = recoverFrom(crash, halfWritten, destroyPreparing);
+        if (error.isSome()) {
+          failures++;
+          std::cerr << "FAILED crash " << crash.point
+                    << (halfWritten ? ", half written checkpoint" : "")
+                    << (destroyPreparing ? ", preparing container destroyed"
+                                         : "")
+                    << ": " << error.get().message << std::endl;
+        }
+      }
+    }
+  }
+
+  std::cout << "Recovered from " << (runs - failures) << " of " << runs
+            << " crashes at " << crashes.get().size() << " points"
+            << std::endl;
+
+  return failures;
+}
+
+// Times recover() over a checkpoint of mounts records, one volume per
+// record and two per container. Every other container is still running,
+// the volumes of the others are orphans to be detached. Returns false if
+// they were not.
+bool timeRecovery(size_t mounts)
+{
+  Try<string> directory = os::mkdtemp();
+  CHECK_SOME(directory);
+
+  const string workDir = path::join(directory.get(), "work") + "/";
+
+  ExternalMountList mountList;
+  hashset<string> attached;
+  hashset<string> expected;
+  hashset<string> running;
+
+  for (size_t i = 0; i < mounts; i++) {
+    const string container = "c" + stringify(i / 2);
+    const string name = "v" + stringify(i);
+
+    mountList.add_mount()->CopyFrom(
+        Builder().setContainerId(container)
+                 .setVolumeDriver(FAKE_DRIVER)
+                 .setVolumeName(name)
+                 .setMountPoint(path::join(directory.get(), "volumes", name))
+                 .build());
+
+    attached.insert(volume(name));
+    if ((i / 2) % 2 == 0) {
+      running.insert(container);
+      expected.insert(volume(name));
+    }
+  }
+
+  CHECK_SOME(mesos::internal::slave::state::checkpoint(
+      checkpointPath(workDir), mountList));
+
+  FakeVolumeDriver* fake = new FakeVolumeDriver(
+      path::join(directory.get(), "volumes"), attached);
+  Owned<VolumeDriver> driver(fake);
+
+  Try<Isolator*> create = createIsolator(workDir, driver);
+  CHECK_SOME(create);
+
+  bool detached = false;
+  {
+    Owned<Isolator> isolator(create.get());
+
+    list<ContainerState> states;
+    foreach (const string& container, running) {
+      states.push_back(containerState(container));
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    Future<Nothing> recovered =
+      isolator->recover(states, hashset<ContainerID>());
+    recovered.await(SETTLE_TIMEOUT);
+    const Duration recoverTime = stopwatch.elapsed();
+
+    while (fake->attachedVolumes() != expected &&
+           stopwatch.elapsed() < SETTLE_TIMEOUT) {
+      os::sleep(Milliseconds(1));
+    }
+    const Duration detachTime = stopwatch.elapsed();
+
+    detached = recovered.isReady() && settle(*fake, expected);
+
+    std::cout << mounts << " mounts: recover() took " << recoverTime
+              << ", orphans detached after " << detachTime
+              << (detached ? "" : ", FAILED") << std::endl;
+  }
+
+  os::rmdir(directory.get());
+  return detached;
+}
+
+} // namespace {
+
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+
+  size_t failures = runCrashes();
+
+  for (size_t mounts : {10, 100, 1000, 10000}) {
+    if (!timeRecovery(mounts)) {
+      failures++;
+    }
+  }
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
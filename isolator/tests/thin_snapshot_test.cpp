@@ -0,0 +1,106 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that ThinVolumeDriver clones only the thin volumes named with
+// the snapshot prefix, and never the dvdi-<name> volume of a task.
+//
+// The volume group does not exist, so no LVM command the driver runs
+// can change anything. A rejected snapshot fails the mount before
+// lvcreate is run.
+//
+// Exits with a failure if any check fails.
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+
+#include <glog/logging.h>
+
+#include <process/owned.hpp>
+
+#include <stout/strings.hpp>
+#include <stout/try.hpp>
+
+#include "isolator/interface.hpp"
+#include "isolator/thin_volume_driver.hpp"
+#include "isolator/volume_driver.hpp"
+
+using std::string;
+
+using process::Owned;
+
+using namespace mesos::slave;
+
+static constexpr char THIN_POOL[]       = "dvdi-test-no-such-vg/pool";
+static constexpr char SNAPSHOT_PREFIX[] = "snapshot-";
+
+static size_t failures = 0;
+
+static void expect(bool condition, const string& check)
+{
+  if (!condition) {
+    std::cerr << "FAILED: " << check << std::endl;
+    failures++;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+
+  ThinVolumeDriver driver(THIN_POOL, SNAPSHOT_PREFIX);
+
+  expect(driver.snapshotAllowed("snapshot-orders-golden"),
+         "a snapshot named with the prefix is allowed");
+
+  expect(!driver.snapshotAllowed("dvdi-orders-test-42"),
+         "the volume of a task is rejected");
+  expect(!driver.snapshotAllowed("orders-golden"),
+         "a volume without the prefix is rejected");
+  expect(!driver.snapshotAllowed("snapshot-"),
+         "the bare prefix is rejected");
+  expect(!driver.snapshotAllowed(""),
+         "an empty name is rejected");
+  expect(!driver.snapshotAllowed("snapshot-../dvdi-orders-test-42"),
+         "a name that is not an LVM name is rejected");
+
+  // Even a prefix of dvdi- never lets a task volume be cloned.
+  ThinVolumeDriver taskPrefix(THIN_POOL, THIN_VOLUME_PREFIX);
+  expect(!taskPrefix.snapshotAllowed("dvdi-orders-test-42"),
+         "the volume of a task is rejected with a dvdi- prefix");
+
+  Owned<ExternalMount> em(
+      Builder().setContainerId("thin-snapshot-test")
+               .setVolumeDriver(NATIVE_LVM_DRIVER)
+               .setVolumeName("orders-test-43")
+               .setOptions(string(FROM_SNAPSHOT_OPTION) + "=" +
+                           "dvdi-orders-test-42")
+               .build());
+
+  Try<MountedVolume> mounted = driver.mount(*em);
+  expect(mounted.isError() &&
+         strings::contains(mounted.error(), "is not allowed"),
+         "mounting a clone of the volume of a task fails before lvcreate");
+
+  if (failures == 0) {
+    std::cout << "All snapshot checks passed" << std::endl;
+  }
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}